@@ -0,0 +1,37 @@
+// renders one large list section with the mustache renderer, each item has a nested and an inverted section
+// prints the best time of 5 renders and the size of the output, the size must be the same when comparing renderers
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "smide/mustache.hpp"
+
+using namespace kainjow::mustache;
+
+int main()
+{
+    data root{data::type::object};
+    data items{data::type::list};
+    for(int index = 0; index < 200000; index += 1)
+    {
+        data item{data::type::object};
+        item["name"] = "n" + std::to_string(index);
+        item["flag"] = (index % 2) ? data::type::bool_true : data::type::bool_false;
+        items.push_back(item);
+    }
+    root["items"] = std::move(items);
+
+    mustache pattern{"{{#items}}    {{name}} = {{#flag}}on{{/flag}}{{^flag}}off{{/flag}}, // {{name}}\n{{/items}}"};
+    double best = 1e9;
+    std::size_t size = 0;
+    for(int repeat = 0; repeat < 5; repeat += 1)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        size = pattern.render(root).size();
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        best = std::min(best, elapsed.count());
+    }
+    std::printf("%.3fs for 200000 items, %zu bytes\n", best, size);
+}
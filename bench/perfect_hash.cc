@@ -0,0 +1,77 @@
+// compares the lookup generated by <perfect_hash> with a linear strcmp and a std::unordered_map
+// the keys come from perfect_hash_keys.py, 1M lookups where every 4th key isn't in the table
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bench_keys.h"
+
+namespace
+{
+    constexpr int key_count = sizeof(names) / sizeof(names[0]);
+
+    int find_linear(const char* key)
+    {
+        for(int index = 0; index < key_count; index += 1)
+        {
+            if(std::strcmp(names[index], key) == 0)
+            {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    template<typename Lookup>
+    void time(const char* label, const std::vector<std::string>& queries, long repeats, Lookup lookup)
+    {
+        long found = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(long repeat = 0; repeat < repeats; repeat += 1)
+        {
+            for(const auto& query: queries)
+            {
+                found += lookup(query) ? 1 : 0;
+            }
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+        const double ns = elapsed.count() / static_cast<double>(repeats * static_cast<long>(queries.size()));
+        std::printf("%-14s %10.1f ns/lookup (%ld found)\n", label, ns, found);
+    }
+}
+
+int main()
+{
+    std::vector<std::string> queries;
+    for(long index = 0; index < 1000000; index += 1)
+    {
+        std::string query = names[(index * 7919L) % key_count];
+        if(index % 4 == 0)
+        {
+            query += "x";
+        }
+        queries.emplace_back(std::move(query));
+    }
+
+    std::unordered_map<std::string_view, int> map;
+    for(int index = 0; index < key_count; index += 1)
+    {
+        map.emplace(names[index], index);
+    }
+
+    std::printf("%d keys\n", key_count);
+    time("perfect_hash", queries, 5, [](const std::string& query) { return find_name(query).has_value(); });
+    time("unordered_map", queries, 5, [&map](const std::string& query) { return map.find(query) != map.end(); });
+
+    // the linear search is too slow for all queries on big tables
+    if(key_count > 5000)
+    {
+        queries.resize(2000);
+    }
+    time("linear strcmp", queries, 1, [](const std::string& query) { return find_linear(query.c_str()) >= 0; });
+}
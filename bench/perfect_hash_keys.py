@@ -0,0 +1,28 @@
+# writes a smide_table input with <count> random keys for perfect_hash.cc
+# usage: perfect_hash_keys.py <count> <output.xml>
+
+import random
+import sys
+
+
+def main():
+    count = int(sys.argv[1])
+    random.seed(count)
+    keys = set()
+    while len(keys) < count:
+        keys.add(''.join(random.choice('abcdefghijklmnopqrstuvwxyz_') for _ in range(random.randint(4, 20))))
+
+    with open(sys.argv[2], 'w') as out:
+        out.write('<file>\n<tables>\n<Keys>\n<col name="name"/>\n')
+        for key in sorted(keys):
+            out.write(f'<row name="{key}"/>\n')
+        out.write('</Keys>\n</tables>\n<gen>\n')
+        out.write('<expand_data name="const char* names" table="Keys" var="a">'
+                  '<var name="a" col="name" transform="string"/></expand_data>\n')
+        out.write('<perfect_hash name="find_name" type="int" table="Keys" var="a" col="name">'
+                  '<var name="a" col="name" transform="string"/>[0]</perfect_hash>\n')
+        out.write('</gen>\n</file>\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,40 @@
+// runs smide_table on the inputs from table_inputs.py and prints the best time of 5 runs and the rows expanded per second
+// large expands a table with SMIDE_BENCH_LARGE_ROWS rows 3 times, nested expands a table with SMIDE_BENCH_NESTED_ROWS
+// rows inside itself 3 levels deep
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+    void time(const char* label, long expanded_rows)
+    {
+        const std::string dir = SMIDE_BENCH_DIR;
+        const std::string command = std::string{"\""} + SMIDE_TABLE_PATH + "\" \"" + dir + "/" + label + ".out.cc\" \"" + dir
+            + "/" + label + ".out.h\" \"" + dir + "/" + label + ".xml\"";
+        double best = 1e9;
+        for(int repeat = 0; repeat < 5; repeat += 1)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            if(std::system(command.c_str()) != 0)
+            {
+                std::printf("%s failed\n", command.c_str());
+                std::exit(1);
+            }
+            const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+            best = std::min(best, elapsed.count());
+        }
+        std::printf("%-7s %8ld rows %7.3fs %12.0f rows/s\n", label, expanded_rows, best, static_cast<double>(expanded_rows) / best);
+    }
+}
+
+int main()
+{
+    const long large_rows = SMIDE_BENCH_LARGE_ROWS;
+    const long nested_rows = SMIDE_BENCH_NESTED_ROWS;
+    time("large", large_rows * 3);
+    time("nested", nested_rows * nested_rows * nested_rows);
+}
@@ -0,0 +1,51 @@
+# writes the smide_table inputs for table.cc
+# usage: table_inputs.py large <rows> <output.xml>
+#        table_inputs.py nested <rows> <output.xml>
+# large is a table with 3 columns that is expanded 3 times, nested is a table expanded inside itself 3 levels deep so the
+# innermost body runs rows^3 times
+
+import random
+import sys
+
+
+def write_table(out, rows):
+    out.write('<tables>\n<Big>\n<col name="name"/>\n<col name="str"/>\n<col name="value"/>\n')
+    for index in range(rows):
+        out.write(f'<row name="Item_{index}" str="item {index}" value="{random.randint(0, 1000000)}"/>\n')
+    out.write('</Big>\n</tables>\n')
+
+
+def write_large(out, rows):
+    write_table(out, rows)
+    out.write('<gen>\n')
+    out.write('<enum name="Big"><expand table="Big" var="a"><var name="a" col="name"/>,\n</expand>Big_COUNT</enum>\n')
+    out.write('<expand_data name="const char* big_strings" table="Big" var="a">'
+              '<var name="a" col="str" transform="string"/></expand_data>\n')
+    out.write('<expand_data name="int big_values" table="Big" var="a"><var name="a" col="value"/></expand_data>\n')
+    out.write('</gen>\n')
+
+
+def write_nested(out, rows):
+    write_table(out, rows)
+    out.write('<gen>\n<expand table="Big" var="a"><expand table="Big" var="b"><expand table="Big" var="c">'
+              'f(<var name="a" col="name"/>, <var name="b" col="value"/>, <var name="c" col="str" transform="string"/>);\n'
+              '</expand></expand></expand>\n</gen>\n')
+
+
+def main():
+    kind = sys.argv[1]
+    rows = int(sys.argv[2])
+    random.seed(rows)
+    with open(sys.argv[3], 'w') as out:
+        out.write('<file>\n')
+        if kind == 'large':
+            write_large(out, rows)
+        elif kind == 'nested':
+            write_nested(out, rows)
+        else:
+            sys.exit(f'unknown input {kind}')
+        out.write('</file>\n')
+
+
+if __name__ == '__main__':
+    main()
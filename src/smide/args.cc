@@ -0,0 +1,94 @@
+#include "smide/args.h"
+
+#include <charconv>
+
+namespace
+{
+    // removes count arguments starting at index
+    void remove_args(int* argc, char** argv, int index, int count)
+    {
+        for(int dest = index; dest + count < *argc; dest += 1)
+        {
+            argv[dest] = argv[dest + count];
+        }
+        *argc -= count;
+    }
+}
+
+bool take_flag(int* argc, char** argv, std::string_view name)
+{
+    bool found = false;
+    for(int index = 1; index < *argc;)
+    {
+        if(name == argv[index])
+        {
+            found = true;
+            remove_args(argc, argv, index, 1);
+        }
+        else
+        {
+            index += 1;
+        }
+    }
+    return found;
+}
+
+std::optional<std::string> take_option(int* argc, char** argv, std::string_view name)
+{
+    for(int index = 1; index < *argc; index += 1)
+    {
+        if(name != argv[index])
+        {
+            continue;
+        }
+
+        if(index + 1 >= *argc)
+        {
+            remove_args(argc, argv, index, 1);
+            return std::string{};
+        }
+
+        std::string value = argv[index + 1];
+        remove_args(argc, argv, index, 2);
+        return value;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> take_options(int* argc, char** argv, std::string_view name)
+{
+    std::vector<std::string> values;
+    while(auto value = take_option(argc, argv, name))
+    {
+        values.emplace_back(std::move(*value));
+    }
+    return values;
+}
+
+std::optional<std::size_t> parse_count(const std::string& value)
+{
+    // from_chars takes no sign but check anyway so -1 never wraps around
+    if(value.empty() || value[0] == '-')
+    {
+        return std::nullopt;
+    }
+
+    std::size_t count = 0;
+    const char* end = value.data() + value.size();
+    const auto [last, error] = std::from_chars(value.data(), end, count);
+    if(error != std::errc{} || last != end || count == 0 || count > MAX_COUNT)
+    {
+        return std::nullopt;
+    }
+    return count;
+}
+
+std::optional<PatternOutput> parse_pattern_output(const std::string& value)
+{
+    const auto separator = value.find('=');
+    if(separator == std::string::npos || separator == 0 || separator + 1 == value.size())
+    {
+        return std::nullopt;
+    }
+    return PatternOutput{value.substr(0, separator), value.substr(separator + 1)};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// removes the flag from the arguments, returns true if it was present
+bool take_flag(int* argc, char** argv, std::string_view name);
+
+// removes the option and the value following it from the arguments
+// returns nullopt if not present and an empty string if the value is missing
+std::optional<std::string> take_option(int* argc, char** argv, std::string_view name);
+
+// removes every occurrence of the option and its value, returns the values in order
+std::vector<std::string> take_options(int* argc, char** argv, std::string_view name);
+
+// the largest value parse_count accepts
+constexpr std::size_t MAX_COUNT = 1024;
+
+// parses the value of a count option like --jobs, returns nullopt unless the whole value is a number in 1..MAX_COUNT
+std::optional<std::size_t> parse_count(const std::string& value);
+
+// the value of an option like --render pattern=output
+struct PatternOutput
+{
+    std::string pattern;
+    std::string output;
+};
+
+// splits at the first =, returns nullopt if there is no = or either side is empty
+std::optional<PatternOutput> parse_pattern_output(const std::string& value);
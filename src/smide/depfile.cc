@@ -0,0 +1,78 @@
+#include "smide/depfile.h"
+
+#include <algorithm>
+
+#include "smide/output.h"
+
+namespace
+{
+    void add_unique(std::vector<std::string>* paths, const std::string& path)
+    {
+        if(std::find(paths->begin(), paths->end(), path) == paths->end())
+        {
+            paths->push_back(path);
+        }
+    }
+
+    std::string escape_path(const std::string& path)
+    {
+        std::string ret;
+        ret.reserve(path.size());
+        for(char c: path)
+        {
+            switch(c)
+            {
+            case ' ':
+            case '#':
+                ret += '\\';
+                ret += c;
+                break;
+            case '$':
+                ret += "$$";
+                break;
+            default:
+                ret += c;
+                break;
+            }
+        }
+        return ret;
+    }
+}
+
+bool Depfile::add_output(const std::string& path)
+{
+    if(listed_outputs_.insert(path).second == false)
+    {
+        return false;
+    }
+    outputs_.push_back(path);
+    return true;
+}
+
+void Depfile::add_input(const std::string& path)
+{
+    add_unique(&inputs_, path);
+}
+
+bool Depfile::write(const std::string& path, std::ostream& err) const
+{
+    OutputFile file{path};
+
+    bool first = true;
+    for(const auto& output: outputs_)
+    {
+        if(first) first = false;
+        else file.write(" ");
+        file.write(escape_path(output));
+    }
+    file.write(":");
+
+    for(const auto& input: inputs_)
+    {
+        file.write(" \\\n  ");
+        file.write(escape_path(input));
+    }
+    file.write("\n");
+
+    return file.commit(err);
+}
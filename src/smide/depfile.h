@@ -0,0 +1,23 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Make/Ninja style depfile listing every input a tool read to produce its outputs.
+class Depfile
+{
+public:
+    // returns false if the path was already listed
+    bool add_output(const std::string& path);
+    void add_input(const std::string& path);
+
+    // write the depfile, left untouched if the dependencies didn't change
+    bool write(const std::string& path, std::ostream& err) const;
+
+private:
+    std::vector<std::string> outputs_;
+    std::vector<std::string> inputs_;
+    std::unordered_set<std::string> listed_outputs_; // a tool can have a lot of outputs, don't search the list
+};
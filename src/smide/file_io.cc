@@ -0,0 +1,27 @@
+#include "smide/file_io.h"
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+int open_for_reading(const char* path) { return _open(path, _O_RDONLY | _O_BINARY); }
+int create_new_file(const char* path) { return _open(path, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE); }
+long long read_some(int fd, char* data, std::size_t size) { return _read(fd, data, static_cast<unsigned int>(size)); }
+long long write_some(int fd, const char* data, std::size_t size) { return _write(fd, data, static_cast<unsigned int>(size)); }
+int close_file(int fd) { return _close(fd); }
+int process_id() { return _getpid(); }
+#else
+int open_for_reading(const char* path) { return ::open(path, O_RDONLY); }
+int create_new_file(const char* path) { return ::open(path, O_WRONLY | O_CREAT | O_EXCL, 0666); }
+long long read_some(int fd, char* data, std::size_t size) { return ::read(fd, data, size); }
+long long write_some(int fd, const char* data, std::size_t size) { return ::write(fd, data, size); }
+int close_file(int fd) { return ::close(fd); }
+int process_id() { return static_cast<int>(::getpid()); }
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+// thin wrappers over the posix and windows file functions, failures return -1 and set errno like the functions they wrap
+
+int open_for_reading(const char* path);
+
+// creates a file that must not exist yet, fails with EEXIST if it does
+int create_new_file(const char* path);
+
+long long read_some(int fd, char* data, std::size_t size);
+long long write_some(int fd, const char* data, std::size_t size);
+int close_file(int fd);
+
+int process_id();
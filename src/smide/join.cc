@@ -1,9 +1,16 @@
 #include <iostream>
+#include <memory>
 #include <string>
-#include <fstream>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
-#include "smide/tinyxml2.h" // v11.0.0
+#include "smide/tinyxml2.h" // v11.0.0 + ParseInPlace, see smide/readme.md
+#include "smide/args.h"
+#include "smide/depfile.h"
+#include "smide/mapped_file.h"
+#include "smide/manifest.h"
+#include "smide/output.h"
 
 using namespace tinyxml2;
 
@@ -17,51 +24,146 @@ enum
 };
 
 
-std::string file_to_error(const std::string& filename, XMLNode* node)
+std::string file_to_error(const std::string& filename, int line)
 {
     std::ostringstream ss;
-    ss << filename << '(';
-    if (node)
+    ss << filename << '(' << line << "): ";
+    return ss.str();
+}
+
+#define ERR(line, mess) err << file_to_error(filename, line)<< "error: " << mess << "\n"; status = false; continue
+
+// a <pattern> element copied out of the document
+struct Pattern
+{
+    int line = 0;
+    std::string name;
+    std::string text;
+    std::string error; // set instead of name and text when the element can't be used
+};
+
+// The patterns of an input file, shared by all jobs that use it.
+// tinyxml2 decodes attributes and text in place the first time they are read so the document can't be read by several
+// jobs at once, everything the jobs need is copied out while loading and the document is thrown away.
+struct LoadedFile
+{
+    bool loaded = false;
+    bool has_root = false;
+    std::vector<Pattern> patterns;
+};
+
+std::unique_ptr<LoadedFile> load_file(const char* filename)
+{
+    auto file = std::make_unique<LoadedFile>();
+    MappedFile source;
+    XMLDocument doc;
+    file->loaded = source.open(filename) && doc.ParseInPlace(source.data(), source.size()) == XML_SUCCESS;
+    if(file->loaded == false)
     {
-        ss << node->GetLineNum();
+        return file;
     }
-    else
+    const auto* root = doc.RootElement();
+    if(root == nullptr)
     {
-        ss << "-1";
+        return file;
     }
-    ss << "): ";
-    return ss.str();
+    file->has_root = true;
+
+    constexpr const char* pattern = "pattern";
+    for(auto* elem = root->FirstChildElement(pattern); elem != nullptr; elem = elem->NextSiblingElement(pattern))
+    {
+        Pattern p;
+        p.line = elem->GetLineNum();
+        const char* name = elem->Attribute("name");
+        const char* text = elem->GetText();
+        if(name == nullptr)
+        {
+            p.error = "missing name attribute";
+        }
+        else if(text == nullptr)
+        {
+            p.error = "elem is missing text";
+        }
+        else
+        {
+            p.name = name;
+            p.text = text;
+        }
+        file->patterns.emplace_back(std::move(p));
+    }
+    return file;
 }
 
-#define ERR(node, mess) std::cerr << file_to_error(filename, node)<< "error: " << mess << "\n"; status = false; continue
+// a pattern name and the file it's extracted to
+struct Extraction
+{
+    std::string pattern;
+    std::unique_ptr<OutputFile> out;
+    const Pattern* found = nullptr; // in the current file
+};
 
-int main(int argc, char** argv)
+int run(int argc, char** argv, std::ostream& err, SharedInputs<LoadedFile>* inputs)
 {
+    const bool print_stats = take_flag(&argc, argv, "--stats");
+    const auto depfile_path = take_option(&argc, argv, "--depfile");
+    const auto extract_args = take_options(&argc, argv, "--extract");
     if(argc < ARG_COUNT)
     {
-        std::cerr << "Invalid number of arguments\n";
+        err << "Invalid number of arguments\n";
+        return -1;
+    }
+    if(depfile_path && depfile_path->empty())
+    {
+        err << "Missing path for --depfile\n";
         return -1;
     }
 
     bool status = true;
+    Depfile depfile;
 
-    const std::string mode_arg = argv[MODE_ARG];
-    
-    const char* const output_path = argv[OUTPUT_FILE];
-    std::ofstream out(output_path);
-    if (out.good() == false)
+    // the pattern from the command line and any number of --extract pattern=output
+    std::vector<Extraction> extractions;
+    std::unordered_map<std::string, std::vector<std::size_t>> extractions_by_pattern;
+    const auto add_extraction = [&](const std::string& pattern, const std::string& output_path)
     {
-        std::cerr << "Failed to open file for writing: " << output_path << "\n";
-        return -2;
+        for(const auto& e: extractions)
+        {
+            if(e.out->path() == output_path)
+            {
+                err << "Output " << output_path << " is used more than once\n";
+                return false;
+            }
+        }
+        extractions_by_pattern[pattern].push_back(extractions.size());
+        extractions.push_back(Extraction{pattern, std::make_unique<OutputFile>(output_path)});
+        depfile.add_output(output_path);
+        return true;
+    };
+    if(add_extraction(argv[MODE_ARG], argv[OUTPUT_FILE]) == false)
+    {
+        return -1;
+    }
+    for(const auto& extract: extract_args)
+    {
+        const auto parsed = parse_pattern_output(extract);
+        if(parsed.has_value() == false)
+        {
+            err << "Invalid --extract " << extract << ", expected pattern=output\n";
+            return -1;
+        }
+        if(add_extraction(parsed->pattern, parsed->output) == false)
+        {
+            return -1;
+        }
     }
 
     const std::string macro_arg = argv[MACRO_ARG];
-    const bool add_line_directive = [macro_arg]()
+    const bool add_line_directive = [macro_arg, &err]()
         {
             if (macro_arg == "add_line") return true;
             if (macro_arg == "no_line") return false;
 
-            std::cerr << "Invalid macro argument " << macro_arg << "\n";
+            err << "Invalid macro argument " << macro_arg << "\n";
             return false;
         }();
 
@@ -70,54 +172,87 @@ int main(int argc, char** argv)
     {
         const char* const filename = argv[arg_index];
 
-        XMLDocument doc;
+        const auto& file = inputs->get(filename, [filename]() { return load_file(filename); });
 
-        if (doc.LoadFile(filename) != XML_SUCCESS)
+        if (file.loaded == false)
         {
-            ERR(nullptr, "Failed to load file `" << filename << "`");
+            ERR(-1, "Failed to load file `" << filename << "`");
         }
+        depfile.add_input(filename);
 
-        auto* root = doc.RootElement();
-        if(root == nullptr)
+        if(file.has_root == false)
         {
-            ERR(nullptr, "Missing root");
+            ERR(-1, "Missing root");
         }
 
-        XMLElement* found = nullptr;
-        constexpr const char* pattern = "pattern";
-        for(auto* elem = root->FirstChildElement(pattern); elem != nullptr; elem = elem->NextSiblingElement(pattern))
+        for(auto& e: extractions)
         {
-            const char* name = elem->Attribute("name");
-            if(name == nullptr)
-            {
-                ERR(elem, "missing name attribute");
-            }
+            e.found = nullptr;
+        }
 
-            const char* text = elem->GetText();
-            if(text == nullptr)
+        // a single pass routes each pattern to all outputs that want it
+        for(const auto& pattern: file.patterns)
+        {
+            if(pattern.error.empty() == false)
             {
-                ERR(elem, "elem is missing text");
+                ERR(pattern.line, pattern.error);
             }
 
-            if (mode_arg != name) continue;
+            const auto found_extractions = extractions_by_pattern.find(pattern.name);
+            if (found_extractions == extractions_by_pattern.end()) continue;
 
-            if(found != nullptr)
+            for(const auto index: found_extractions->second)
             {
-                std::cerr << file_to_error(filename, elem) << "error: found duplicate node named " << name << "\n";
-                std::cerr << file_to_error(filename, found) << "note: previous node found here" << "\n";
-                status = false;
-                continue;
-            }
+                auto& e = extractions[index];
+                if(e.found != nullptr)
+                {
+                    err << file_to_error(filename, pattern.line) << "error: found duplicate node named " << pattern.name << "\n";
+                    err << file_to_error(filename, e.found->line) << "note: previous node found here" << "\n";
+                    status = false;
+                    continue;
+                }
 
-            found = elem;
-            if(add_line_directive)
-            {
-                out << "#line " << elem->GetLineNum() << " \"" << filename << "\"\n";
+                e.found = &pattern;
+                auto& out = *e.out;
+                if(add_line_directive)
+                {
+                    out.write("#line ");
+                    out.write(std::to_string(pattern.line));
+                    out.write(" \"");
+                    out.write(filename);
+                    out.write("\"\n");
+                }
+
+                out.write(pattern.text);
+                out.write("\n\n");
             }
+        }
+    }
 
-            out << text << "\n\n";
+    for (auto& e: extractions)
+    {
+        if (e.out->commit(err) == false)
+        {
+            status = false;
+        }
+        else if (print_stats)
+        {
+            e.out->print_stats(err);
         }
     }
+    if (depfile_path && depfile.write(*depfile_path, err) == false)
+    {
+        status = false;
+    }
 
     return status ? 0 : -2;
 }
+
+int main(int argc, char** argv)
+{
+    SharedInputs<LoadedFile> inputs;
+    return run_jobs(argc, argv, [&inputs](int argc, char** argv, std::ostream& err, bool)
+    {
+        return run(argc, argv, err, &inputs);
+    });
+}
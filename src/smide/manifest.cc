@@ -0,0 +1,160 @@
+#include "smide/manifest.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "smide/args.h"
+#include "smide/thread_pool.h"
+
+namespace
+{
+    struct Job
+    {
+        int line = 0;
+        std::vector<std::string> args;
+
+        int result = 0;
+        std::ostringstream output;
+    };
+
+    bool split_arguments(const std::string& line, std::vector<std::string>* args)
+    {
+        std::size_t index = 0;
+        while(index < line.size())
+        {
+            if(line[index] == ' ' || line[index] == '\t' || line[index] == '\r')
+            {
+                index += 1;
+                continue;
+            }
+
+            std::string arg;
+            if(line[index] == '"')
+            {
+                const auto end = line.find('"', index + 1);
+                if(end == std::string::npos)
+                {
+                    return false;
+                }
+                arg = line.substr(index + 1, end - index - 1);
+                index = end + 1;
+            }
+            else
+            {
+                while(index < line.size() && line[index] != ' ' && line[index] != '\t' && line[index] != '\r')
+                {
+                    arg += line[index];
+                    index += 1;
+                }
+            }
+            args->push_back(arg);
+        }
+        return true;
+    }
+}
+
+int run_manifest(const std::string& app_name, const std::string& manifest_path, std::size_t thread_count, const RunJob& run_job)
+{
+    std::ifstream file(manifest_path);
+    if(file.good() == false)
+    {
+        std::cerr << "Failed to open manifest " << manifest_path << "\n";
+        return -1;
+    }
+
+    bool status = true;
+    std::vector<std::unique_ptr<Job>> jobs;
+    std::string line;
+    for(int line_number = 1; std::getline(file, line); line_number += 1)
+    {
+        const auto first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#')
+        {
+            continue;
+        }
+
+        auto job = std::make_unique<Job>();
+        job->line = line_number;
+        job->args.push_back(app_name);
+        if(split_arguments(line, &job->args) == false)
+        {
+            std::cerr << manifest_path << '(' << line_number << "): error: unterminated quote\n";
+            status = false;
+            continue;
+        }
+        jobs.emplace_back(std::move(job));
+    }
+
+    {
+        ThreadPool pool{thread_count};
+        for(auto& job: jobs)
+        {
+            pool.add([&run_job, job = job.get()]()
+            {
+                std::vector<char*> argv;
+                for(auto& arg: job->args)
+                {
+                    argv.push_back(arg.data());
+                }
+                argv.push_back(nullptr);
+                job->result = run_job(static_cast<int>(job->args.size()), argv.data(), job->output, true);
+            });
+        }
+        pool.wait();
+    }
+
+    for(const auto& job: jobs)
+    {
+        std::cerr << job->output.str();
+        if(job->result != 0)
+        {
+            std::cerr << manifest_path << '(' << job->line << "): error: job failed with " << job->result << "\n";
+            status = false;
+        }
+    }
+
+    return status ? 0 : -2;
+}
+
+int run_jobs(int argc, char** argv, const RunJob& run_job)
+{
+    const auto manifest_path = take_option(&argc, argv, "--manifest");
+    const auto jobs = take_option(&argc, argv, "--jobs");
+
+    if(manifest_path.has_value() == false)
+    {
+        if(jobs)
+        {
+            std::cerr << "--jobs requires --manifest\n";
+            return -1;
+        }
+        return run_job(argc, argv, std::cerr, false);
+    }
+
+    if(manifest_path->empty())
+    {
+        std::cerr << "Missing path for --manifest\n";
+        return -1;
+    }
+    if(argc != 1)
+    {
+        std::cerr << "Unexpected arguments with --manifest\n";
+        return -1;
+    }
+
+    std::size_t thread_count = 0;
+    if(jobs)
+    {
+        const auto count = parse_count(*jobs);
+        if(count.has_value() == false)
+        {
+            std::cerr << "Invalid number of jobs " << *jobs << "\n";
+            return -1;
+        }
+        thread_count = *count;
+    }
+
+    return run_manifest(argv[0], *manifest_path, thread_count, run_job);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// A manifest runs many jobs of a tool in one process.
+// Each line is a job with the same arguments the tool takes on the command line, empty lines and lines starting with # are ignored.
+// Arguments are separated by whitespace and can be quoted with "".
+// manifest_job is true when the job is one of many running on the manifest's thread pool, a job should then not start
+// threads of its own by default.
+using RunJob = std::function<int(int argc, char** argv, std::ostream& err, bool manifest_job)>;
+
+// runs all jobs on a thread pool, the output of each job is printed in manifest order once all jobs are done
+int run_manifest(const std::string& app_name, const std::string& manifest_path, std::size_t thread_count, const RunJob& run_job);
+
+// runs the manifest given with --manifest (and optionally --jobs) or the single job described by the command line
+int run_jobs(int argc, char** argv, const RunJob& run_job);
+
+// Inputs that are loaded at most once and then shared, read only, between the jobs.
+template<typename T>
+class SharedInputs
+{
+public:
+    // returns the input for key, load is only called the first time a key is requested
+    template<typename Load>
+    const T& get(const std::string& key, Load&& load)
+    {
+        Entry* entry = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& found = entries_[key];
+            if(found == nullptr)
+            {
+                found = std::make_unique<Entry>();
+            }
+            entry = found.get();
+        }
+        std::call_once(entry->once, [&]() { entry->value = load(); });
+        return *entry->value;
+    }
+
+private:
+    struct Entry
+    {
+        std::once_flag once;
+        std::unique_ptr<T> value;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Entry>> entries_;
+};
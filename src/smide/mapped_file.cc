@@ -0,0 +1,107 @@
+#include "smide/mapped_file.h"
+
+#include <cerrno>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "smide/file_io.h"
+
+namespace
+{
+    constexpr std::size_t READ_CHUNK_SIZE = 64 * 1024;
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if(mapped_size_ > 0)
+    {
+        munmap(data_, mapped_size_);
+    }
+#endif
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    const int fd = open_for_reading(path.c_str());
+    if(fd < 0)
+    {
+        return false;
+    }
+
+#ifndef _WIN32
+    struct stat info;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        const auto size = static_cast<std::size_t>(info.st_size);
+        const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        // reserve room for the terminating 0, the part of the last page after the file is zero filled and when the
+        // file fills its last page the 0 comes from the anonymous page after it
+        const std::size_t mapped_size = (size + 1 + page - 1) / page * page;
+        void* region = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(region != MAP_FAILED)
+        {
+            if(mmap(region, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED)
+            {
+                close_file(fd);
+                data_ = static_cast<char*>(region);
+                size_ = size;
+                mapped_size_ = mapped_size;
+                return true;
+            }
+            munmap(region, mapped_size);
+        }
+    }
+#endif
+
+    // windows, pipes and files that can't be mapped are read instead
+    const bool read = read_all(fd);
+    close_file(fd);
+    return read;
+}
+
+bool MappedFile::read_all(int fd)
+{
+    buffer_.clear();
+    std::size_t size = 0;
+    while(true)
+    {
+        buffer_.resize(size + READ_CHUNK_SIZE);
+        const auto read = read_some(fd, buffer_.data() + size, READ_CHUNK_SIZE);
+        if(read < 0 && errno == EINTR) continue;
+        if(read < 0)
+        {
+            buffer_.clear();
+            return false;
+        }
+        if(read == 0)
+        {
+            break;
+        }
+        size += static_cast<std::size_t>(read);
+    }
+    buffer_.resize(size + 1);
+    buffer_[size] = 0;
+    data_ = buffer_.data();
+    size_ = size;
+    return true;
+}
+
+char* MappedFile::data()
+{
+    return data_;
+}
+
+const char* MappedFile::data() const
+{
+    return data_;
+}
+
+std::size_t MappedFile::size() const
+{
+    return size_;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A file mapped copy-on-write into memory, parsers can modify it in place without the change reaching the file.
+// The content is always followed by a 0 so it can be parsed as a terminated string.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns false if the file couldn't be read
+    bool open(const std::string& path);
+
+    char* data();
+    const char* data() const;
+    std::size_t size() const;
+
+private:
+    bool read_all(int fd);
+
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t mapped_size_ = 0; // 0 when the content is in buffer_
+    std::vector<char> buffer_;
+};
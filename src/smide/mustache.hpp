@@ -30,6 +30,7 @@
 #ifndef KAINJOW_MUSTACHE_HPP
 #define KAINJOW_MUSTACHE_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <functional>
@@ -37,6 +38,7 @@
 #include <memory>
 #include <sstream>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
 #define KAINJOW_MUSTACHE_VERSION_MAJOR 5
@@ -163,10 +165,119 @@ private:
     std::unique_ptr<type2> type2_;
 };
 
+// A name together with its hash, tag names are hashed once when parsed instead of on every lookup
+template <typename string_type>
+class basic_key {
+public:
+    basic_key(const string_type& name)
+        : name_(name)
+        , hash_(std::hash<string_type>{}(name_))
+    {
+    }
+    basic_key(string_type&& name)
+        : name_(std::move(name))
+        , hash_(std::hash<string_type>{}(name_))
+    {
+    }
+    basic_key(const typename string_type::value_type* name)
+        : basic_key(string_type{name})
+    {
+    }
+    basic_key()
+        : basic_key(string_type{})
+    {
+    }
+
+    const string_type& str() const { return name_; }
+    std::size_t hash() const { return hash_; }
+    operator const string_type&() const { return name_; }
+
+    bool operator==(const basic_key& other) const {
+        return hash_ == other.hash_ && name_ == other.name_;
+    }
+
+private:
+    string_type name_;
+    std::size_t hash_;
+};
+
+// A x.y-like name split when parsed, empty for a name without dots
+template <typename string_type>
+using basic_path = std::vector<basic_key<string_type>>;
+
 template <typename string_type>
 class basic_data;
+
+// Object members in one vector sorted on the name hash, most objects are small so a lookup is a short binary search
+// over integers and building the object is a single allocation.
 template <typename string_type>
-using basic_object = std::unordered_map<string_type, basic_data<string_type>>;
+class basic_object {
+public:
+    using value_type = std::pair<basic_key<string_type>, basic_data<string_type>>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    basic_object() = default;
+    basic_object(std::initializer_list<value_type> members) {
+        items_.reserve(members.size());
+        for (const auto& member : members) {
+            insert(member);
+        }
+    }
+
+    bool empty() const { return items_.empty(); }
+    std::size_t size() const { return items_.size(); }
+    iterator begin() { return items_.begin(); }
+    iterator end() { return items_.end(); }
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    iterator find(const basic_key<string_type>& key) {
+        const auto it = lower_bound(key);
+        return it != items_.end() && it->first == key ? it : items_.end();
+    }
+    const_iterator find(const basic_key<string_type>& key) const {
+        const auto it = lower_bound(key);
+        return it != items_.end() && it->first == key ? it : items_.end();
+    }
+
+    // like std::map, an existing member is left as is
+    std::pair<iterator, bool> insert(value_type member) {
+        const auto it = lower_bound(member.first);
+        if (it != items_.end() && it->first == member.first) {
+            return {it, false};
+        }
+        return {items_.insert(it, std::move(member)), true};
+    }
+
+    iterator erase(const_iterator it) {
+        return items_.erase(it);
+    }
+
+    basic_data<string_type>& operator[] (const basic_key<string_type>& key) {
+        auto it = lower_bound(key);
+        if (it == items_.end() || !(it->first == key)) {
+            it = items_.emplace(it, key, basic_data<string_type>{});
+        }
+        return it->second;
+    }
+
+private:
+    static bool is_before(const value_type& member, const basic_key<string_type>& key) {
+        if (member.first.hash() != key.hash()) {
+            return member.first.hash() < key.hash();
+        }
+        return member.first.str() < key.str();
+    }
+    iterator lower_bound(const basic_key<string_type>& key) {
+        return std::lower_bound(items_.begin(), items_.end(), key, &is_before);
+    }
+    const_iterator lower_bound(const basic_key<string_type>& key) const {
+        return std::lower_bound(items_.begin(), items_.end(), key, &is_before);
+    }
+
+    std::vector<value_type> items_;
+};
 template <typename string_type>
 using basic_list = std::vector<basic_data<string_type>>;
 template <typename string_type>
@@ -194,28 +305,26 @@ public:
     // Construction
     basic_data() : basic_data(type::object) {
     }
-    basic_data(const string_type& string) : type_{type::string} {
-        str_.reset(new string_type(string));
+    basic_data(const string_type& string) : type_{type::string}, value_{string} {
     }
-    basic_data(const typename string_type::value_type* string) : type_{type::string} {
-        str_.reset(new string_type(string));
+    basic_data(string_type&& string) : type_{type::string}, value_{std::move(string)} {
     }
-    basic_data(const basic_object<string_type>& obj) : type_{type::object} {
-        obj_.reset(new basic_object<string_type>(obj));
+    basic_data(const typename string_type::value_type* string) : type_{type::string}, value_{string_type{string}} {
     }
-    basic_data(const basic_list<string_type>& l) : type_{type::list} {
-        list_.reset(new basic_list<string_type>(l));
+    basic_data(const basic_object<string_type>& obj) : type_{type::object}, value_{obj} {
+    }
+    basic_data(const basic_list<string_type>& l) : type_{type::list}, value_{l} {
     }
     basic_data(type t) : type_{t} {
         switch (type_) {
             case type::object:
-                obj_.reset(new basic_object<string_type>);
+                value_.template emplace<basic_object<string_type>>();
                 break;
             case type::string:
-                str_.reset(new string_type);
+                value_.template emplace<string_type>();
                 break;
             case type::list:
-                list_.reset(new basic_list<string_type>);
+                value_.template emplace<basic_list<string_type>>();
                 break;
             default:
                 break;
@@ -224,76 +333,44 @@ public:
     basic_data(const string_type& name, const basic_data& var) : basic_data{} {
         set(name, var);
     }
-    basic_data(const basic_partial<string_type>& p) : type_{type::partial} {
-        partial_.reset(new basic_partial<string_type>(p));
+    basic_data(const basic_partial<string_type>& p) : type_{type::partial}, value_{p} {
     }
-    basic_data(const basic_lambda<string_type>& l) : type_{type::lambda} {
-        lambda_.reset(new basic_lambda_t<string_type>(l));
+    basic_data(const basic_lambda<string_type>& l) : type_{type::lambda}, value_{std::make_shared<const basic_lambda_t<string_type>>(l)} {
     }
-    basic_data(const basic_lambda2<string_type>& l) : type_{type::lambda2} {
-        lambda_.reset(new basic_lambda_t<string_type>(l));
+    basic_data(const basic_lambda2<string_type>& l) : type_{type::lambda2}, value_{std::make_shared<const basic_lambda_t<string_type>>(l)} {
     }
-    basic_data(const basic_lambda_t<string_type>& l) {
+    basic_data(const basic_lambda_t<string_type>& l) : type_{type::invalid}, value_{std::make_shared<const basic_lambda_t<string_type>>(l)} {
         if (l.is_type1()) {
             type_ = type::lambda;
         } else if (l.is_type2()) {
             type_ = type::lambda2;
         }
-        lambda_.reset(new basic_lambda_t<string_type>(l));
     }
     basic_data(bool b) : type_{b ? type::bool_true : type::bool_false} {
     }
 
-    // Copying
-    basic_data(const basic_data& dat) : type_(dat.type_) {
-        if (dat.obj_) {
-            obj_.reset(new basic_object<string_type>(*dat.obj_));
-        } else if (dat.str_) {
-            str_.reset(new string_type(*dat.str_));
-        } else if (dat.list_) {
-            list_.reset(new basic_list<string_type>(*dat.list_));
-        } else if (dat.partial_) {
-            partial_.reset(new basic_partial<string_type>(*dat.partial_));
-        } else if (dat.lambda_) {
-            lambda_.reset(new basic_lambda_t<string_type>(*dat.lambda_));
-        }
+    // Copying, lambdas can't change so copies share them
+    basic_data(const basic_data& dat) : type_{dat.type_}, value_{dat.value_} {
+        copy_count() += 1;
     }
 
-    // Move
-    basic_data(basic_data&& dat) : type_{dat.type_} {
-        if (dat.obj_) {
-            obj_ = std::move(dat.obj_);
-        } else if (dat.str_) {
-            str_ = std::move(dat.str_);
-        } else if (dat.list_) {
-            list_ = std::move(dat.list_);
-        } else if (dat.partial_) {
-            partial_ = std::move(dat.partial_);
-        } else if (dat.lambda_) {
-            lambda_ = std::move(dat.lambda_);
-        }
+    // number of data values copied on this thread, a copy of a list or object copies all children too
+    static std::size_t& copy_count() {
+        static thread_local std::size_t count = 0;
+        return count;
+    }
+
+    // Move, noexcept so a growing list moves its items instead of copying them
+    basic_data(basic_data&& dat) noexcept : type_{dat.type_}, value_{std::move(dat.value_)} {
         dat.type_ = type::invalid;
+        dat.value_ = std::monostate{};
     }
-    basic_data& operator= (basic_data&& dat) {
+    basic_data& operator= (basic_data&& dat) noexcept {
         if (this != &dat) {
-            obj_.reset();
-            str_.reset();
-            list_.reset();
-            partial_.reset();
-            lambda_.reset();
-            if (dat.obj_) {
-                obj_ = std::move(dat.obj_);
-            } else if (dat.str_) {
-                str_ = std::move(dat.str_);
-            } else if (dat.list_) {
-                list_ = std::move(dat.list_);
-            } else if (dat.partial_) {
-                partial_ = std::move(dat.partial_);
-            } else if (dat.lambda_) {
-                lambda_ = std::move(dat.lambda_);
-            }
             type_ = dat.type_;
+            value_ = std::move(dat.value_);
             dat.type_ = type::invalid;
+            dat.value_ = std::monostate{};
         }
         return *this;
     }
@@ -332,26 +409,32 @@ public:
 
     // Object data
     bool is_empty_object() const {
-        return is_object() && obj_->empty();
+        return is_object() && object_value().empty();
     }
     bool is_non_empty_object() const {
-        return is_object() && !obj_->empty();
+        return is_object() && !object_value().empty();
     }
     void set(const string_type& name, const basic_data& var) {
         if (is_object()) {
-            auto it = obj_->find(name);
-            if (it != obj_->end()) {
-                obj_->erase(it);
-            }
-            obj_->insert(std::pair<string_type,basic_data>{name, var});
+            std::get<basic_object<string_type>>(value_)[name] = basic_data{var};
         }
     }
     const basic_data* get(const string_type& name) const {
         if (!is_object()) {
             return nullptr;
         }
-        const auto& it = obj_->find(name);
-        if (it == obj_->end()) {
+        return get(basic_key<string_type>{name});
+    }
+    const basic_data* get(const typename string_type::value_type* name) const {
+        return get(string_type{name});
+    }
+    const basic_data* get(const basic_key<string_type>& key) const {
+        if (!is_object()) {
+            return nullptr;
+        }
+        const auto& obj = object_value();
+        const auto it = obj.find(key);
+        if (it == obj.end()) {
             return nullptr;
         }
         return &it->second;
@@ -360,17 +443,22 @@ public:
     // List data
     void push_back(const basic_data& var) {
         if (is_list()) {
-            list_->push_back(var);
+            std::get<basic_list<string_type>>(value_).push_back(var);
+        }
+    }
+    void push_back(basic_data&& var) {
+        if (is_list()) {
+            std::get<basic_list<string_type>>(value_).push_back(std::move(var));
         }
     }
     const basic_list<string_type>& list_value() const {
-        return *list_;
+        return std::get<basic_list<string_type>>(value_);
     }
     bool is_empty_list() const {
-        return is_list() && list_->empty();
+        return is_list() && list_value().empty();
     }
     bool is_non_empty_list() const {
-        return is_list() && !list_->empty();
+        return is_list() && !list_value().empty();
     }
     basic_data& operator<< (const basic_data& data) {
         push_back(data);
@@ -379,32 +467,40 @@ public:
 
     // String data
     const string_type& string_value() const {
-        return *str_;
+        return std::get<string_type>(value_);
     }
 
     basic_data& operator[] (const string_type& key) {
-        return (*obj_)[key];
+        return std::get<basic_object<string_type>>(value_)[key];
+    }
+
+    const basic_object<string_type>& object_value() const {
+        return std::get<basic_object<string_type>>(value_);
     }
 
     const basic_partial<string_type>& partial_value() const {
-        return (*partial_);
+        return std::get<basic_partial<string_type>>(value_);
     }
 
     const basic_lambda<string_type>& lambda_value() const {
-        return lambda_->type1_value();
+        return std::get<std::shared_ptr<const basic_lambda_t<string_type>>>(value_)->type1_value();
     }
 
     const basic_lambda2<string_type>& lambda2_value() const {
-        return lambda_->type2_value();
+        return std::get<std::shared_ptr<const basic_lambda_t<string_type>>>(value_)->type2_value();
     }
 
 private:
+    // the value is stored in place, a string or an empty object or list doesn't allocate
     type type_;
-    std::unique_ptr<basic_object<string_type>> obj_;
-    std::unique_ptr<string_type> str_;
-    std::unique_ptr<basic_list<string_type>> list_;
-    std::unique_ptr<basic_partial<string_type>> partial_;
-    std::unique_ptr<basic_lambda_t<string_type>> lambda_;
+    std::variant<
+        std::monostate,
+        string_type,
+        basic_object<string_type>,
+        basic_list<string_type>,
+        basic_partial<string_type>,
+        std::shared_ptr<const basic_lambda_t<string_type>>
+    > value_;
 };
 
 template <typename string_type>
@@ -435,11 +531,28 @@ public:
 
     virtual const basic_data<string_type>* get(const string_type& name) const = 0;
     virtual const basic_data<string_type>* get_partial(const string_type& name) const = 0;
+
+    // lookup of a tag name that was hashed when parsed, override if the context can use the hash
+    virtual const basic_data<string_type>* get(const basic_key<string_type>& key) const {
+        return get(key.str());
+    }
+
+    // lookup of a tag name with the path the parser split it into, override if the context can use the path
+    virtual const basic_data<string_type>* get(const basic_key<string_type>& key, const basic_path<string_type>& path) const {
+        (void)path;
+        return get(key);
+    }
+
+    const basic_data<string_type>* get(const typename string_type::value_type* name) const {
+        return get(string_type{name});
+    }
 };
 
 template <typename string_type>
 class context : public basic_context<string_type> {
 public:
+    using basic_context<string_type>::get;
+
     context(const basic_data<string_type>* data) {
         push(data);
     }
@@ -448,38 +561,51 @@ public:
     }
 
     virtual void push(const basic_data<string_type>* data) override {
-        items_.insert(items_.begin(), data);
+        items_.push_back(data);
     }
 
     virtual void pop() override {
-        items_.erase(items_.begin());
+        items_.pop_back();
     }
 
     virtual const basic_data<string_type>* get(const string_type& name) const override {
+        return get(basic_key<string_type>{name});
+    }
+
+    virtual const basic_data<string_type>* get(const basic_key<string_type>& key) const override {
+        const string_type& name = key.str();
         // process {{.}} name
         if (name.size() == 1 && name.at(0) == '.') {
-            return items_.front();
+            return items_.back();
         }
         if (name.find('.') == string_type::npos) {
             // process normal name without having to split which is slower
-            for (const auto& item : items_) {
-                const auto var = item->get(name);
-                if (var) {
-                    return var;
-                }
-            }
-            return nullptr;
+            return find(key);
         }
         // process x.y-like name
         const auto names = split(name, '.');
-        for (const auto& item : items_) {
-            auto var = item;
-            for (const auto& n : names) {
-                var = var->get(n);
-                if (!var) {
-                    break;
-                }
-            }
+        return find(basic_path<string_type>(names.begin(), names.end()));
+    }
+
+    virtual const basic_data<string_type>* get(const basic_key<string_type>& key, const basic_path<string_type>& path) const override {
+        if (path.empty()) {
+            return get(key);
+        }
+        return find(path);
+    }
+
+    virtual const basic_data<string_type>* get_partial(const string_type& name) const override {
+        return find(basic_key<string_type>{name});
+    }
+
+    context(const context&) = delete;
+    context& operator= (const context&) = delete;
+
+private:
+    // the innermost section is last
+    const basic_data<string_type>* find(const basic_key<string_type>& key) const {
+        for (auto item = items_.rbegin(); item != items_.rend(); ++item) {
+            const auto var = (*item)->get(key);
             if (var) {
                 return var;
             }
@@ -487,9 +613,15 @@ public:
         return nullptr;
     }
 
-    virtual const basic_data<string_type>* get_partial(const string_type& name) const override {
-        for (const auto& item : items_) {
-            const auto var = item->get(name);
+    const basic_data<string_type>* find(const basic_path<string_type>& path) const {
+        for (auto item = items_.rbegin(); item != items_.rend(); ++item) {
+            auto var = *item;
+            for (const auto& key : path) {
+                var = var->get(key);
+                if (!var) {
+                    break;
+                }
+            }
             if (var) {
                 return var;
             }
@@ -497,10 +629,6 @@ public:
         return nullptr;
     }
 
-    context(const context&) = delete;
-    context& operator= (const context&) = delete;
-
-private:
     std::vector<const basic_data<string_type>*> items_;
 };
 
@@ -526,12 +654,17 @@ public:
     }
 };
 
+template <typename string_type>
+class basic_mustache;
+
 template <typename string_type>
 class context_internal {
 public:
     basic_context<string_type>& ctx;
     delimiter_set<string_type> delim_set;
     line_buffer_state<string_type> line_buffer;
+    // partials parsed during this render, keyed by the partial text
+    std::unordered_map<string_type, std::unique_ptr<basic_mustache<string_type>>> partials;
 
     context_internal(basic_context<string_type>& a_ctx)
         : ctx(a_ctx)
@@ -554,7 +687,8 @@ enum class tag_type {
 template <typename string_type>
 class mstch_tag /* gcc doesn't allow "tag tag;" so rename the class :( */ {
 public:
-    string_type name;
+    basic_key<string_type> name; // hashed when set so rendering doesn't have to
+    basic_path<string_type> path; // name split on '.' by the parser
     tag_type type = tag_type::text;
     std::shared_ptr<string_type> section_text;
     std::shared_ptr<delimiter_set<string_type>> delim_set;
@@ -564,6 +698,17 @@ public:
     bool is_section_end() const {
         return type == tag_type::section_end;
     }
+
+    // split the name so rendering doesn't have to, call when the name is set
+    void prepare_lookup() {
+        const string_type& str = name.str();
+        path.clear();
+        if (str.size() != 1 && str.find('.') != string_type::npos) {
+            for (auto& n : split(str, '.')) {
+                path.emplace_back(std::move(n));
+            }
+        }
+    }
 };
 
 template <typename string_type>
@@ -770,7 +915,7 @@ private:
             } else if (comp.tag.is_section_end()) {
                 if (sections.size() == 1) {
                     streamstring ss;
-                    ss << "Unopened section \"" << comp.tag.name << "\" at " << comp.position;
+                    ss << "Unopened section \"" << comp.tag.name.str() << "\" at " << comp.position;
                     error_message.assign(ss.str());
                     return;
                 }
@@ -787,9 +932,9 @@ private:
             if (!comp.tag.is_section_begin()) {
                 return component<string_type>::walk_control::walk;
             }
-            if (comp.children.empty() || !comp.children.back().tag.is_section_end() || comp.children.back().tag.name != comp.tag.name) {
+            if (comp.children.empty() || !comp.children.back().tag.is_section_end() || !(comp.children.back().tag.name == comp.tag.name)) {
                 streamstring ss;
-                ss << "Unclosed section \"" << comp.tag.name << "\" at " << comp.position;
+                ss << "Unclosed section \"" << comp.tag.name.str() << "\" at " << comp.position;
                 error_message.assign(ss.str());
                 return component<string_type>::walk_control::stop;
             }
@@ -842,7 +987,7 @@ private:
             tag.name = contents;
         } else if (contents.empty()) {
             tag.type = tag_type::variable;
-            tag.name.clear();
+            tag.name = string_type{};
         } else {
             switch (contents.at(0)) {
                 case '#':
@@ -875,6 +1020,7 @@ private:
                 tag.name = trim(name);
             }
         }
+        tag.prepare_lookup();
     }
 };
 
@@ -888,12 +1034,45 @@ public:
         context<string_type> ctx;
         context_internal<string_type> context{ctx};
         parser<string_type> parser{input, context, root_component_, error_message_};
+        compile();
+    }
+
+    // create from an already parsed template, see root_component()
+    explicit basic_mustache(component<string_type> root_component)
+        : basic_mustache() {
+        root_component_ = std::move(root_component);
+        compile();
+    }
+
+    // the program points into the component tree so a copy needs its own
+    basic_mustache(const basic_mustache& other)
+        : error_message_(other.error_message_)
+        , root_component_(other.root_component_)
+        , escape_(other.escape_) {
+        compile();
+    }
+    basic_mustache& operator= (const basic_mustache& other) {
+        if (this != &other) {
+            error_message_ = other.error_message_;
+            root_component_ = other.root_component_;
+            escape_ = other.escape_;
+            compile();
+        }
+        return *this;
     }
+    // moving the tree keeps the children where they are so the program stays valid
+    basic_mustache(basic_mustache&&) = default;
+    basic_mustache& operator= (basic_mustache&&) = default;
 
     bool is_valid() const {
         return error_message_.empty();
     }
 
+    // the parsed template
+    const component<string_type>& root_component() const {
+        return root_component_;
+    }
+
     const string_type& error_message() const {
         return error_message_;
     }
@@ -940,6 +1119,14 @@ public:
         render(handler, context);
     }
 
+    void render(basic_context<string_type>& ctx, const render_handler& handler) {
+        if (!is_valid()) {
+            return;
+        }
+        context_internal<string_type> context{ctx};
+        render(handler, context);
+    }
+
     basic_mustache()
         : escape_(html_escape<string_type>)
     {
@@ -952,6 +1139,64 @@ private:
     basic_mustache(const string_type& input, context_internal<string_type>& ctx)
         : basic_mustache() {
         parser<string_type> parser{input, ctx, root_component_, error_message_};
+        compile();
+    }
+
+    // The component tree flattened for rendering. A section is followed by its body and jumps to end when done.
+    enum class opcode {
+        text,
+        newline,
+        variable,
+        unescaped_variable,
+        section,
+        inverted_section,
+        partial,
+        set_delimiter,
+    };
+
+    struct instruction {
+        opcode code;
+        const component<string_type>* comp;
+        std::size_t end; // one past the section body
+    };
+
+    void compile() {
+        program_.clear();
+        compile_children(root_component_);
+        program_.shrink_to_fit();
+    }
+
+    void compile_children(const component<string_type>& parent) {
+        for (const auto& comp : parent.children) {
+            switch (comp.tag.type) {
+                case tag_type::text:
+                    program_.push_back(instruction{comp.is_newline() ? opcode::newline : opcode::text, &comp, 0});
+                    break;
+                case tag_type::variable:
+                    program_.push_back(instruction{opcode::variable, &comp, 0});
+                    break;
+                case tag_type::unescaped_variable:
+                    program_.push_back(instruction{opcode::unescaped_variable, &comp, 0});
+                    break;
+                case tag_type::section_begin:
+                case tag_type::section_begin_inverted: {
+                    const auto index = program_.size();
+                    program_.push_back(instruction{comp.tag.type == tag_type::section_begin ? opcode::section : opcode::inverted_section, &comp, 0});
+                    compile_children(comp);
+                    program_[index].end = program_.size();
+                    break;
+                }
+                case tag_type::partial:
+                    program_.push_back(instruction{opcode::partial, &comp, 0});
+                    break;
+                case tag_type::set_delimiter:
+                    program_.push_back(instruction{opcode::set_delimiter, &comp, 0});
+                    break;
+                default:
+                    // comments and section ends render nothing
+                    break;
+            }
+        }
     }
 
     string_type render(context_internal<string_type>& ctx) {
@@ -963,9 +1208,7 @@ private:
     }
 
     void render(const render_handler& handler, context_internal<string_type>& ctx, bool root_renderer = true) {
-        root_component_.walk_children([&handler, &ctx, this](component<string_type>& comp) -> typename component<string_type>::walk_control {
-            return render_component(handler, ctx, comp);
-        });
+        execute(handler, ctx, 0, program_.size());
         // process the last line, but only for the top-level renderer
         if (root_renderer) {
             render_current_line(handler, ctx, nullptr);
@@ -993,69 +1236,75 @@ private:
         ctx.line_buffer.data.append(text);
     }
 
-    typename component<string_type>::walk_control render_component(const render_handler& handler, context_internal<string_type>& ctx, component<string_type>& comp) {
-        if (comp.is_text()) {
-            if (comp.is_newline()) {
-                render_current_line(handler, ctx, &comp);
-            } else {
-                render_result(ctx, comp.text);
-            }
-            return component<string_type>::walk_control::walk;
-        }
-
-        const mstch_tag<string_type>& tag{comp.tag};
-        const basic_data<string_type>* var = nullptr;
-        switch (tag.type) {
-            case tag_type::variable:
-            case tag_type::unescaped_variable:
-                if ((var = ctx.ctx.get(tag.name)) != nullptr) {
-                    if (!render_variable(handler, var, ctx, tag.type == tag_type::variable)) {
-                        return component<string_type>::walk_control::stop;
+    // runs the instructions in [first, last), an error stops this run like it stopped the walk of a section item
+    void execute(const render_handler& handler, context_internal<string_type>& ctx, std::size_t first, std::size_t last) {
+        std::size_t index = first;
+        while (index < last) {
+            const instruction& ins = program_[index];
+            const component<string_type>& comp = *ins.comp;
+            const mstch_tag<string_type>& tag{comp.tag};
+            const basic_data<string_type>* var = nullptr;
+            index += 1;
+            switch (ins.code) {
+                case opcode::text:
+                    render_result(ctx, comp.text);
+                    break;
+                case opcode::newline:
+                    render_current_line(handler, ctx, &comp);
+                    break;
+                case opcode::variable:
+                case opcode::unescaped_variable:
+                    if ((var = ctx.ctx.get(tag.name, tag.path)) != nullptr) {
+                        if (!render_variable(handler, var, ctx, ins.code == opcode::variable)) {
+                            return;
+                        }
                     }
-                }
-                break;
-            case tag_type::section_begin:
-                if ((var = ctx.ctx.get(tag.name)) != nullptr) {
-                    if (var->is_lambda() || var->is_lambda2()) {
-                        if (!render_lambda(handler, var, ctx, render_lambda_escape::optional, *comp.tag.section_text, true)) {
-                            return component<string_type>::walk_control::stop;
+                    break;
+                case opcode::section:
+                    if ((var = ctx.ctx.get(tag.name, tag.path)) != nullptr) {
+                        if (var->is_lambda() || var->is_lambda2()) {
+                            if (!render_lambda(handler, var, ctx, render_lambda_escape::optional, *tag.section_text, true)) {
+                                return;
+                            }
+                        } else if (!var->is_false() && !var->is_empty_list()) {
+                            render_section(handler, ctx, index, ins.end, var);
                         }
-                    } else if (!var->is_false() && !var->is_empty_list()) {
-                        render_section(handler, ctx, comp, var);
                     }
-                }
-                return component<string_type>::walk_control::skip;
-            case tag_type::section_begin_inverted:
-                if ((var = ctx.ctx.get(tag.name)) == nullptr || var->is_false() || var->is_empty_list()) {
-                    render_section(handler, ctx, comp, var);
-                }
-                return component<string_type>::walk_control::skip;
-            case tag_type::partial:
-                if ((var = ctx.ctx.get_partial(tag.name)) != nullptr && (var->is_partial() || var->is_string())) {
-                    const auto& partial_result = var->is_partial() ? var->partial_value()() : var->string_value();
-                    basic_mustache tmpl{partial_result};
-                    tmpl.set_custom_escape(escape_);
-                    if (!tmpl.is_valid()) {
-                        error_message_ = tmpl.error_message();
-                    } else {
-                        tmpl.render(handler, ctx, false);
+                    index = ins.end;
+                    break;
+                case opcode::inverted_section:
+                    if ((var = ctx.ctx.get(tag.name, tag.path)) == nullptr || var->is_false() || var->is_empty_list()) {
+                        render_section(handler, ctx, index, ins.end, var);
+                    }
+                    index = ins.end;
+                    break;
+                case opcode::partial:
+                    if ((var = ctx.ctx.get_partial(tag.name)) != nullptr && (var->is_partial() || var->is_string())) {
+                        const auto& partial_result = var->is_partial() ? var->partial_value()() : var->string_value();
+                        auto& cached = ctx.partials[partial_result];
+                        if (!cached) {
+                            cached.reset(new basic_mustache{partial_result});
+                            cached->set_custom_escape(escape_);
+                        }
+                        basic_mustache& tmpl = *cached;
                         if (!tmpl.is_valid()) {
                             error_message_ = tmpl.error_message();
+                        } else {
+                            tmpl.render(handler, ctx, false);
+                            if (!tmpl.is_valid()) {
+                                error_message_ = tmpl.error_message();
+                            }
+                        }
+                        if (!tmpl.is_valid()) {
+                            return;
                         }
                     }
-                    if (!tmpl.is_valid()) {
-                        return component<string_type>::walk_control::stop;
-                    }
-                }
-                break;
-            case tag_type::set_delimiter:
-                ctx.delim_set = *comp.tag.delim_set;
-                break;
-            default:
-                break;
+                    break;
+                case opcode::set_delimiter:
+                    ctx.delim_set = *tag.delim_set;
+                    break;
+            }
         }
-
-        return component<string_type>::walk_control::walk;
     }
 
     enum class render_lambda_escape {
@@ -1130,17 +1379,14 @@ private:
         return true;
     }
 
-    void render_section(const render_handler& handler, context_internal<string_type>& ctx, component<string_type>& incomp, const basic_data<string_type>* var) {
-        const auto callback = [&handler, &ctx, this](component<string_type>& comp) -> typename component<string_type>::walk_control {
-            return render_component(handler, ctx, comp);
-        };
+    void render_section(const render_handler& handler, context_internal<string_type>& ctx, std::size_t first, std::size_t last, const basic_data<string_type>* var) {
         if (var && var->is_non_empty_list()) {
             for (const auto& item : var->list_value()) {
                 // account for the section begin tag
                 ctx.line_buffer.contained_section_tag = true;
 
                 const context_pusher<string_type> ctxpusher{ctx, &item};
-                incomp.walk_children(callback);
+                execute(handler, ctx, first, last);
 
                 // ctx may have been cleared. account for the section end tag
                 ctx.line_buffer.contained_section_tag = true;
@@ -1150,7 +1396,7 @@ private:
             ctx.line_buffer.contained_section_tag = true;
 
             const context_pusher<string_type> ctxpusher{ctx, var};
-            incomp.walk_children(callback);
+            execute(handler, ctx, first, last);
 
             // ctx may have been cleared. account for the section end tag
             ctx.line_buffer.contained_section_tag = true;
@@ -1158,7 +1404,7 @@ private:
             // account for the section begin tag
             ctx.line_buffer.contained_section_tag = true;
 
-            incomp.walk_children(callback);
+            execute(handler, ctx, first, last);
 
             // ctx may have been cleared. account for the section end tag
             ctx.line_buffer.contained_section_tag = true;
@@ -1169,6 +1415,7 @@ private:
     string_type error_message_;
     component<string_type> root_component_;
     escape_handler escape_;
+    std::vector<instruction> program_;
 };
 
 using mustache = basic_mustache<std::string>;
@@ -0,0 +1,308 @@
+#include "smide/output.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "smide/file_io.h"
+
+namespace
+{
+    // makes the temporary names of this process unique
+    std::atomic<unsigned> temp_counter{0};
+
+    // how much is kept in memory before it's compared or written
+    constexpr std::size_t BUFFER_SIZE = 256 * 1024;
+}
+
+OutputFile::OutputFile(std::string path)
+    : path_(std::move(path))
+{
+}
+
+OutputFile::~OutputFile()
+{
+    // not committed, don't leave a half written temporary behind
+    const bool remove_temp = temp_fd_ >= 0;
+    close_files();
+    if(remove_temp)
+    {
+        std::error_code ec;
+        std::filesystem::remove(temp_path_, ec);
+    }
+}
+
+void OutputFile::write(std::string_view text)
+{
+    buffer_.append(text.data(), text.size());
+    if(buffer_.size() >= BUFFER_SIZE)
+    {
+        flush();
+    }
+}
+
+void OutputFile::flush()
+{
+    if(error_.empty() == false || buffer_.empty())
+    {
+        buffer_.clear();
+        return;
+    }
+
+    if(started_ == false)
+    {
+        started_ = true;
+        syscalls_ += 1;
+        existing_fd_ = open_for_reading(path_.c_str());
+    }
+
+    if(temp_fd_ < 0 && existing_fd_ >= 0)
+    {
+        if(matches_existing_file(buffer_))
+        {
+            matched_ += buffer_.size();
+            buffer_.clear();
+            return;
+        }
+    }
+
+    if(temp_fd_ < 0)
+    {
+        start_writing();
+    }
+    write_to_temp(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+bool OutputFile::matches_existing_file(std::string_view text)
+{
+    compare_buffer_.resize(BUFFER_SIZE);
+    std::size_t offset = 0;
+    while(offset < text.size())
+    {
+        syscalls_ += 1;
+        const auto read = read_some(existing_fd_, compare_buffer_.data(), std::min(compare_buffer_.size(), text.size() - offset));
+        if(read < 0 && errno == EINTR) continue;
+        if(read <= 0)
+        {
+            return false;
+        }
+        if(std::memcmp(compare_buffer_.data(), text.data() + offset, static_cast<std::size_t>(read)) != 0)
+        {
+            return false;
+        }
+        offset += static_cast<std::size_t>(read);
+    }
+    return true;
+}
+
+void OutputFile::start_writing()
+{
+    // write next to the target and rename over it so the file is never seen half written.
+    // Other jobs and processes may be writing the same output, each writer creates a file with a name of its own and never
+    // opens one that exists, so a file the user has next to the output isn't replaced either.
+    do
+    {
+        temp_path_ = path_ + ".smide-" + std::to_string(process_id()) + "-" + std::to_string(temp_counter.fetch_add(1)) + ".tmp";
+        syscalls_ += 1;
+        temp_fd_ = create_new_file(temp_path_.c_str());
+    } while(temp_fd_ < 0 && errno == EEXIST);
+    if(temp_fd_ < 0)
+    {
+        fail("Failed to open file for writing: " + temp_path_ + ": " + std::strerror(errno));
+        return;
+    }
+
+    // the replaced file keeps its permissions
+    syscalls_ += 1;
+    std::error_code ec;
+    const auto existing = std::filesystem::status(path_, ec);
+    if(!ec && std::filesystem::exists(existing))
+    {
+        syscalls_ += 1;
+        std::filesystem::permissions(temp_path_, existing.permissions(), ec);
+        if(ec)
+        {
+            fail("Failed to set permissions of " + temp_path_ + ": " + ec.message());
+            return;
+        }
+    }
+
+    if(existing_fd_ >= 0)
+    {
+        syscalls_ += 1;
+        close_file(existing_fd_);
+        existing_fd_ = -1;
+    }
+    if(matched_ == 0)
+    {
+        return;
+    }
+
+    // the part that matched was never kept around, copy it from the existing file
+    syscalls_ += 1;
+    const int fd = open_for_reading(path_.c_str());
+    if(fd < 0)
+    {
+        fail("Failed to read " + path_ + ": " + std::strerror(errno));
+        return;
+    }
+    compare_buffer_.resize(BUFFER_SIZE);
+    std::size_t left = matched_;
+    while(left > 0 && error_.empty())
+    {
+        syscalls_ += 1;
+        const auto read = read_some(fd, compare_buffer_.data(), std::min(compare_buffer_.size(), left));
+        if(read < 0 && errno == EINTR) continue;
+        if(read <= 0)
+        {
+            fail("Failed to read " + path_ + ": " + (read < 0 ? std::strerror(errno) : "file changed while writing"));
+            break;
+        }
+        write_to_temp(compare_buffer_.data(), static_cast<std::size_t>(read));
+        left -= static_cast<std::size_t>(read);
+    }
+    syscalls_ += 1;
+    close_file(fd);
+}
+
+void OutputFile::write_to_temp(const char* data, std::size_t size)
+{
+    // a single write unless the os decides to write less
+    while(size > 0 && error_.empty())
+    {
+        syscalls_ += 1;
+        const auto written = write_some(temp_fd_, data, size);
+        if(written < 0)
+        {
+            if(errno == EINTR) continue;
+            fail("Failed to write " + temp_path_ + ": " + std::strerror(errno));
+            break;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        bytes_written_ += static_cast<std::size_t>(written);
+    }
+}
+
+void OutputFile::fail(const std::string& message)
+{
+    if(error_.empty())
+    {
+        error_ = message;
+    }
+    const bool remove_temp = temp_fd_ >= 0;
+    close_files();
+    if(remove_temp)
+    {
+        std::error_code ec;
+        std::filesystem::remove(temp_path_, ec);
+    }
+}
+
+void OutputFile::close_files()
+{
+    if(existing_fd_ >= 0)
+    {
+        syscalls_ += 1;
+        close_file(existing_fd_);
+        existing_fd_ = -1;
+    }
+    if(temp_fd_ >= 0)
+    {
+        syscalls_ += 1;
+        close_file(temp_fd_);
+        temp_fd_ = -1;
+    }
+}
+
+bool OutputFile::commit(std::ostream& err)
+{
+    // everything fit in the buffer, most changes also change the size so check that before reading anything
+    bool size_is_same = false;
+    if(started_ == false)
+    {
+        started_ = true;
+        syscalls_ += 1;
+        std::error_code ec;
+        const auto existing_size = std::filesystem::file_size(path_, ec);
+        size_is_same = !ec && existing_size == buffer_.size();
+        if(size_is_same)
+        {
+            syscalls_ += 1;
+            existing_fd_ = open_for_reading(path_.c_str());
+        }
+    }
+    flush();
+
+    if(error_.empty() && temp_fd_ < 0 && existing_fd_ >= 0)
+    {
+        // everything matched, the existing file is the same if it has nothing more
+        char extra = 0;
+        long long read = 0;
+        if(size_is_same == false)
+        {
+            do
+            {
+                syscalls_ += 1;
+                read = read_some(existing_fd_, &extra, 1);
+            } while(read < 0 && errno == EINTR);
+        }
+        if(read == 0)
+        {
+            close_files();
+            unchanged_ = true;
+            return true;
+        }
+    }
+
+    if(error_.empty() && temp_fd_ < 0)
+    {
+        start_writing();
+    }
+
+    if(error_.empty())
+    {
+        syscalls_ += 1;
+        const int fd = temp_fd_;
+        temp_fd_ = -1;
+        if(close_file(fd) != 0)
+        {
+            error_ = "Failed to write " + temp_path_ + ": " + std::strerror(errno);
+            std::error_code ec;
+            std::filesystem::remove(temp_path_, ec);
+        }
+    }
+
+    if(error_.empty())
+    {
+        syscalls_ += 1;
+        std::error_code ec;
+        std::filesystem::rename(temp_path_, path_, ec);
+        if(ec)
+        {
+            error_ = "Failed to replace " + path_ + ": " + ec.message();
+            std::filesystem::remove(temp_path_, ec);
+        }
+    }
+
+    if(error_.empty() == false)
+    {
+        err << error_ << "\n";
+        return false;
+    }
+    return true;
+}
+
+void OutputFile::print_stats(std::ostream& out) const
+{
+    out << path_ << ": " << (unchanged_ ? "unchanged, " : "") << bytes_written_ << " bytes, " << syscalls_ << " syscalls\n";
+}
+
+const std::string& OutputFile::path() const
+{
+    return path_;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A generated file, written through a bounded buffer so memory doesn't grow with the size of the output.
+// While the output matches the file already on disk nothing is written, the temporary file is only created at the first
+// difference. If the whole file is the same it is left untouched so the build doesn't see a change.
+class OutputFile
+{
+public:
+    explicit OutputFile(std::string path);
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    void write(std::string_view text);
+
+    // replace the file on disk if the content differs, returns false and reports to err on failure
+    bool commit(std::ostream& err);
+
+    void print_stats(std::ostream& out) const;
+
+    const std::string& path() const;
+
+private:
+    void flush();
+    bool matches_existing_file(std::string_view text);
+    void start_writing();
+    void write_to_temp(const char* data, std::size_t size);
+    void fail(const std::string& message);
+    void close_files();
+
+    std::string path_;
+    std::string temp_path_;
+    std::string buffer_;
+    std::vector<char> compare_buffer_;
+
+    bool started_ = false;
+    int existing_fd_ = -1; // open while everything so far matches the existing file
+    std::size_t matched_ = 0;
+    int temp_fd_ = -1; // open once the output differs
+    std::string error_;
+
+    bool unchanged_ = false;
+    std::size_t bytes_written_ = 0;
+    std::size_t syscalls_ = 0;
+};
@@ -1,9 +1,25 @@
-#include "smide/tinyxml2.h" // v11.0.0
+#include "smide/tinyxml2.h" // v11.0.0 + ParseInPlace, see smide/readme.md
+#include "smide/args.h"
+#include "smide/depfile.h"
+#include "smide/mapped_file.h"
+#include "smide/manifest.h"
+#include "smide/output.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
-#include <fstream>
 #include <sstream>
 
 using namespace tinyxml2;
@@ -16,79 +32,95 @@ enum
     ARG_COUNT
 };
 
-using Row = std::map<std::string, std::string>; // name -> value
-using Table = std::vector<Row>;
-using AllTables = std::map<std::string, Table>;
-
-struct Output
+// the column names are stored once per table and each row is a dense array of cells
+struct Table
 {
-    AllTables* tables;
-    std::ofstream* source_file;
-    std::ofstream* header_file;
-
-    bool write_header = true;
-    bool write_source = false;
-    std::map<std::string, Row> variables;
-    std::string between;
+    std::vector<std::string> columns;
+    std::vector<std::string> cells; // row after row, one cell per column
+    std::size_t row_count = 0;
 
-    Output(AllTables* t, std::ofstream* s, std::ofstream* h)
-        : tables(t)
-        , source_file(s)
-        , header_file(h)
+    [[nodiscard]] const std::string& cell(std::size_t row, std::size_t column) const
     {
+        return cells[row * columns.size() + column];
     }
 
-    void write_raw(const char* str) const
+    [[nodiscard]] std::optional<std::size_t> column_index(const std::string& name) const
     {
-        if(write_header)
-        {
-            (*header_file) << str;
-        }
-        if(write_source)
+        for(std::size_t index = 0; index < columns.size(); index += 1)
         {
-            (*source_file) << str;
+            if(columns[index] == name)
+            {
+                return index;
+            }
         }
+        return std::nullopt;
     }
+};
+using AllTables = std::map<std::string, Table>;
 
-    void write_string(const std::string& str) const
-    {
-        write_raw(str.c_str());
-    }
+enum class Target
+{
+    header,
+    source
+};
 
-    [[nodiscard]] Output only_source() const
-    {
-        Output r = *this;
-        r.write_header = false;
-        r.write_source = true;
-        return r;
-    }
+enum class Transform
+{
+    none,
+    string
+};
 
-    [[nodiscard]] Output only_header() const
-    {
-        Output r = *this;
-        r.write_header = true;
-        r.write_source = false;
-        return r;
-    }
+// a <gen> element is compiled once into a flat list of instructions that is then executed for each row
+enum class OpCode
+{
+    emit_text,     // write text to the current target
+    switch_target, // make target the current target
+    loop_table,    // push a binding and run the next body_size instructions once per row in table with the row bound to it, text is written between rows
+    emit_column,   // write cell column in table of the row in binding
+};
+
+struct Instruction
+{
+    OpCode op;
+    std::string text = {};
+    Target target = Target::header;
+    const Table* table = nullptr;
+    std::size_t binding = 0; // index in the binding stack
+    std::size_t column = 0;
+    Transform transform = Transform::none;
+    std::size_t body_size = 0;
+};
 
-    [[nodiscard]] Output with_var(const std::string& name, const Row& row) const
+using Program = std::vector<Instruction>;
+
+struct Output
+{
+    OutputFile* source_file;
+    OutputFile* header_file;
+
+    Target target = Target::header;
+    std::vector<std::size_t> bindings; // the current row of each enclosing expansion, innermost last
+
+    Output(OutputFile* s, OutputFile* h)
+        : source_file(s)
+        , header_file(h)
     {
-        Output r = *this;
-        r.variables[name] = row;
-        return r;
     }
 
-    [[nodiscard]] Output with_between(const std::string& b) const
+    void write_string(const std::string& str)
     {
-        Output r = *this;
-        r.between = b;
-        return r;
+        if(target == Target::header)
+        {
+            header_file->write(str);
+        }
+        else
+        {
+            source_file->write(str);
+        }
     }
 
-    // Output(const Output& rhs) = default;
-    // Output(Output&& rhs) = default;
-    // Output& operator=(const Output& rhs) = default;
-    // Output& operator=(Output&& rhs) = default;
+    Output(const Output& rhs) = delete;
+    Output& operator=(const Output& rhs) = delete;
 };
 
 std::string file_to_error(const std::string& filename, XMLNode* node)
@@ -107,11 +139,11 @@ std::string file_to_error(const std::string& filename, XMLNode* node)
     return ss.str();
 }
 
-#define ERR(node, mess) std::cerr << file_to_error(filename, node)<< "error: " << mess << "\n"; status = false; continue
+#define ERR(node, mess) err << file_to_error(filename, node)<< "error: " << mess << "\n"; status = false; continue
 
-std::string transform_string(const std::string& function, const std::string& value)
+std::string transform_string(Transform function, const std::string& value)
 {
-    if (function == "string")
+    if (function == Transform::string)
     {
         std::ostringstream ss;
         ss << "\"";
@@ -139,202 +171,1261 @@ std::string transform_string(const std::string& function, const std::string& val
         ss << "\"";
         return ss.str();
     }
-    else if(function == "raw" || function == "none")
+    else
     {
         return value;
     }
+}
+
+Transform transform_from_name(const std::string& function, std::ostream& err)
+{
+    if (function == "string")
+    {
+        return Transform::string;
+    }
+    else if(function == "raw" || function == "none")
+    {
+        return Transform::none;
+    }
     else
     {
-        std::cerr << "Unknown function " << function << "\n";
-        return value;
+        err << "Unknown function " << function << "\n";
+        return Transform::none;
     }
 }
 
-bool generate_rows(const std::string& filename, XMLElement* root, const Output& o)
+// the smallest unsigned type that can hold max_value, keeps generated index arrays compact
+const char* smallest_unsigned_type(std::uint64_t max_value)
+{
+    if(max_value <= 0xff) return "std::uint8_t";
+    if(max_value <= 0xffff) return "std::uint16_t";
+    if(max_value <= 0xffffffff) return "std::uint32_t";
+    return "std::uint64_t";
+}
+
+// The hashes of a <perfect_hash> lookup, written once at the top of the header and guarded so headers from several runs
+// can be included together.
+// The key is read as whole words instead of byte by byte, the words overlap for keys that aren't a multiple of 8 long but
+// the length is hashed first so keys of different lengths still differ. The functions below compute exactly the same when generating.
+constexpr const char* PERFECT_HASH_HELPERS = R"(#ifndef SMIDE_PERFECT_HASH_V1
+#define SMIDE_PERFECT_HASH_V1
+namespace smide_perfect_hash
 {
-    const auto expand = [&filename](const Output& o, const Table& table, const std::string& var_name, XMLElement* elem)
+    constexpr std::uint64_t byte(const char* p, std::size_t index, int shift)
     {
-        bool status = true;
-        bool first = true;
-        for (const auto& row : table)
+        return std::uint64_t{static_cast<unsigned char>(p[index])} << shift;
+    }
+    constexpr std::uint64_t read4(const char* p)
+    {
+        return byte(p, 0, 0) | byte(p, 1, 8) | byte(p, 2, 16) | byte(p, 3, 24);
+    }
+    constexpr std::uint64_t read8(const char* p)
+    {
+        return read4(p) | read4(p + 4) << 32;
+    }
+    constexpr std::uint64_t hash(std::string_view key)
+    {
+        const char* p = key.data();
+        const std::size_t size = key.size();
+        std::uint64_t hash = (14695981039346656037ull ^ size) * 0x9e3779b97f4a7c15ull;
+        std::uint64_t word = 0;
+        if (size >= 8)
+        {
+            for (std::size_t index = 0; index + 8 < size; index += 8)
+            {
+                hash = (hash ^ read8(p + index)) * 0x9e3779b97f4a7c15ull;
+            }
+            word = read8(p + size - 8);
+        }
+        else if (size >= 4)
+        {
+            word = read4(p) | read4(p + size - 4) << 32;
+        }
+        else if (size > 0)
         {
-            if (first) first = false;
-            else o.write_string(o.between);
+            word = byte(p, 0, 0) | byte(p, size / 2, 8) | byte(p, size - 1, 16);
+        }
+        return (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    }
+    constexpr std::size_t bucket(std::uint64_t hash, std::uint64_t bucket_count)
+    {
+        return static_cast<std::size_t>(((hash >> 32) * bucket_count) >> 32);
+    }
+    constexpr std::size_t slot(std::uint64_t hash, std::uint64_t seed, std::uint64_t slot_count)
+    {
+        const std::uint64_t mixed = (hash ^ (seed * 0x9e3779b97f4a7c15ull)) * 0xbf58476d1ce4e5b9ull;
+        return static_cast<std::size_t>(((mixed >> 32) * slot_count) >> 32);
+    }
+}
+#endif
+)";
+
+std::uint64_t read_key_bytes(const std::string& key, std::size_t index, std::size_t count)
+{
+    std::uint64_t word = 0;
+    for(std::size_t byte = 0; byte < count; byte += 1)
+    {
+        word |= std::uint64_t{static_cast<unsigned char>(key[index + byte])} << (byte * 8);
+    }
+    return word;
+}
 
-            status = generate_rows(filename, elem, o.with_var(var_name, row)) && status;
+std::uint64_t key_hash(const std::string& key)
+{
+    const auto size = key.size();
+    std::uint64_t hash = (14695981039346656037ull ^ size) * 0x9e3779b97f4a7c15ull;
+    std::uint64_t word = 0;
+    if(size >= 8)
+    {
+        for(std::size_t index = 0; index + 8 < size; index += 8)
+        {
+            hash = (hash ^ read_key_bytes(key, index, 8)) * 0x9e3779b97f4a7c15ull;
         }
-        return status;
-    };
-    bool status = true;
-    for(auto* child = root->FirstChild(); child; child = child->NextSibling())
+        word = read_key_bytes(key, size - 8, 8);
+    }
+    else if(size >= 4)
+    {
+        word = read_key_bytes(key, 0, 4) | read_key_bytes(key, size - 4, 4) << 32;
+    }
+    else if(size > 0)
     {
-        auto* text = child->ToText();
-        if(text != nullptr)
+        word = read_key_bytes(key, 0, 1) | read_key_bytes(key, size / 2, 1) << 8 | read_key_bytes(key, size - 1, 1) << 16;
+    }
+    return (hash ^ word) * 0x9e3779b97f4a7c15ull;
+}
+
+std::size_t hash_bucket(std::uint64_t hash, std::uint64_t bucket_count)
+{
+    return static_cast<std::size_t>(((hash >> 32) * bucket_count) >> 32);
+}
+
+std::size_t hash_slot(std::uint64_t hash, std::uint64_t seed, std::uint64_t slot_count)
+{
+    const std::uint64_t mixed = (hash ^ (seed * 0x9e3779b97f4a7c15ull)) * 0xbf58476d1ce4e5b9ull;
+    return static_cast<std::size_t>(((mixed >> 32) * slot_count) >> 32);
+}
+
+// A minimal perfect hash built with hash and displace: the keys are split into buckets by the first hash and every bucket
+// gets the first seed that moves all its keys to free slots, biggest buckets first while there is the most room.
+struct PerfectHash
+{
+    std::vector<std::uint64_t> seeds; // per bucket
+    std::vector<std::size_t> rows; // the row of the key in each slot
+};
+
+std::optional<PerfectHash> build_perfect_hash(const std::vector<std::uint64_t>& hashes)
+{
+    const auto slot_count = hashes.size();
+    // a key that is alone in its bucket might need to try every slot to find the last free one
+    const std::uint64_t max_seed = std::max<std::uint64_t>(1 << 20, slot_count * 64);
+
+    // more buckets means smaller buckets that are easier to place, start with about three keys per bucket
+    for(std::size_t bucket_count = slot_count / 3 + 1; ; bucket_count = std::min(bucket_count * 2, slot_count))
+    {
+        std::vector<std::vector<std::size_t>> buckets(bucket_count);
+        for(std::size_t row = 0; row < slot_count; row += 1)
         {
-            o.write_raw(text->Value());
-            continue;
+            buckets[hash_bucket(hashes[row], bucket_count)].push_back(row);
         }
+        std::vector<std::size_t> order(bucket_count);
+        for(std::size_t index = 0; index < bucket_count; index += 1)
+        {
+            order[index] = index;
+        }
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t lhs, std::size_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
 
-        auto* elem = child->ToElement();
-        if(elem)
+        PerfectHash result;
+        result.seeds.resize(bucket_count, 0);
+        result.rows.resize(slot_count, 0);
+        std::vector<bool> taken(slot_count, false);
+        std::vector<std::size_t> slots;
+        bool placed_all = true;
+        for(const auto bucket: order)
         {
-            const std::string name = elem->Name();
-            if(name == "source")
+            const auto& rows = buckets[bucket];
+            if(rows.empty())
             {
-                status = generate_rows(filename, elem, o.only_source()) && status;
-            }
-            else if (name == "header")
-            {
-                status = generate_rows(filename, elem, o.only_header()) && status;
+                break;
             }
-            else if (name == "expand")
+            bool placed = false;
+            for(std::uint64_t seed = 0; seed < max_seed && placed == false; seed += 1)
             {
-                const char* table = elem->Attribute("table");
-                if(table == nullptr)
+                slots.clear();
+                placed = true;
+                for(const auto row: rows)
                 {
-                    ERR(elem, "Failed to find table prop");
+                    const auto slot = hash_slot(hashes[row], seed, slot_count);
+                    if(taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                    {
+                        placed = false;
+                        break;
+                    }
+                    slots.push_back(slot);
                 }
-                const auto& found = o.tables->find(table);
-                if(found == o.tables->end())
+                if(placed)
                 {
-                    ERR(elem, "Failed to find table " << table);
+                    result.seeds[bucket] = seed;
+                    for(std::size_t index = 0; index < rows.size(); index += 1)
+                    {
+                        taken[slots[index]] = true;
+                        result.rows[slots[index]] = rows[index];
+                    }
                 }
+            }
+            if(placed == false)
+            {
+                placed_all = false;
+                break;
+            }
+        }
+        if(placed_all)
+        {
+            return result;
+        }
+        if(bucket_count == slot_count)
+        {
+            return std::nullopt;
+        }
+    }
+}
 
-                const char* var_name = elem->Attribute("var");
-                if(var_name == nullptr)
-                {
-                    ERR(elem, "Failed to find prop var");
-                }
+// Strings packed into one blob, a string that is the same as or the end of another one points into it instead of being
+// added again. No pointers means nothing for the loader to relocate.
+struct StringPool
+{
+    std::string blob;
+    std::vector<std::size_t> offsets; // per string
+};
 
-                status = expand(o,  found->second, var_name, elem) && status;
+StringPool build_string_pool(const std::vector<const std::string*>& strings)
+{
+    // with the reversed strings sorted a string that ends another is directly before one of the strings it ends
+    std::vector<std::string> reversed;
+    for(const auto* str: strings)
+    {
+        reversed.emplace_back(str->rbegin(), str->rend());
+    }
+    std::vector<std::size_t> order(strings.size());
+    for(std::size_t index = 0; index < order.size(); index += 1)
+    {
+        order[index] = index;
+    }
+    std::stable_sort(order.begin(), order.end(), [&reversed](std::size_t lhs, std::size_t rhs) { return reversed[lhs] < reversed[rhs]; });
+
+    StringPool pool;
+    pool.offsets.resize(strings.size(), 0);
+    for(std::size_t sorted = order.size(); sorted > 0; sorted -= 1)
+    {
+        const auto index = order[sorted - 1];
+        if(sorted < order.size())
+        {
+            const auto next = order[sorted];
+            const auto& longer = reversed[next];
+            if(longer.compare(0, reversed[index].size(), reversed[index]) == 0)
+            {
+                pool.offsets[index] = pool.offsets[next] + longer.size() - reversed[index].size();
+                continue;
             }
-            else if(name == "var")
+        }
+        pool.offsets[index] = pool.blob.size();
+        pool.blob += *strings[index];
+    }
+    return pool;
+}
+
+// a cell of a numeric <sorted_index>
+struct NumberCell
+{
+    bool integer;
+    bool above_long_long; // an integer that only fits in unsigned_value
+    long long integer_value;
+    unsigned long long unsigned_value; // set for integers that aren't negative
+    long double value;
+};
+
+// reads a cell the way the compiler reads it as a literal, so the keys are sorted by the values the generated code gets:
+// integers with base 0 so 010 is octal and 0x10 is hex, anything else as a finite floating point number
+// integers that don't fit in 64 bits are an error, the compiler wouldn't read them as the value they were sorted by
+std::optional<NumberCell> parse_number_cell(const std::string& cell)
+{
+    if(cell.empty() || std::isspace(static_cast<unsigned char>(cell[0])))
+    {
+        return std::nullopt;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const long long integer = std::strtoll(cell.c_str(), &end, 0);
+    if(*end == 0)
+    {
+        if(errno != ERANGE)
+        {
+            return NumberCell{true, false, integer, static_cast<unsigned long long>(integer), static_cast<long double>(integer)};
+        }
+        if(cell[0] == '-' || cell[0] == '+')
+        {
+            return std::nullopt;
+        }
+        errno = 0;
+        const unsigned long long unsigned_integer = std::strtoull(cell.c_str(), &end, 0);
+        if(errno == ERANGE)
+        {
+            return std::nullopt;
+        }
+        return NumberCell{true, true, 0, unsigned_integer, static_cast<long double>(unsigned_integer)};
+    }
+    const long double value = std::strtold(cell.c_str(), &end);
+    if(*end != 0 || std::isfinite(value) == false)
+    {
+        return std::nullopt;
+    }
+    return NumberCell{false, false, 0, 0, value};
+}
+
+std::string integer_literal(long long value)
+{
+    // -9223372036854775808 is the negation of a literal that doesn't fit
+    if(value == LLONG_MIN)
+    {
+        return "(" + std::to_string(value + 1) + " - 1)";
+    }
+    return std::to_string(value);
+}
+
+// integers above LLONG_MAX need a suffix, a decimal literal without one has no type they fit in
+std::string unsigned_literal(unsigned long long value)
+{
+    return value > static_cast<unsigned long long>(LLONG_MAX) ? std::to_string(value) + "ull" : std::to_string(value);
+}
+
+// the shortest text that reads back as the same value
+std::string number_literal(long double value)
+{
+    if(value == std::trunc(value) && std::fabs(value) < 1e18L)
+    {
+        return integer_literal(static_cast<long long>(value));
+    }
+    constexpr int max_precision = std::numeric_limits<long double>::max_digits10;
+    for(int precision = 1;; precision += 1)
+    {
+        std::ostringstream ss;
+        ss.precision(precision);
+        ss << value;
+        if(precision == max_precision || std::strtold(ss.str().c_str(), nullptr) == value)
+        {
+            // big integral values can be printed without an exponent, they would be integer literals that don't fit
+            const auto text = ss.str();
+            return text.find_first_of(".e") == std::string::npos ? text + ".0" : text;
+        }
+    }
+}
+
+// What the generated code needs at global scope. The elements of a <gen> block can be inside a namespace the user wrote
+// so includes and helpers are collected while compiling and written before the code of any input.
+struct Prelude
+{
+    std::set<std::string> header_includes;
+    std::set<std::string> source_includes;
+    bool perfect_hash_helpers = false;
+
+    void add(const Prelude& other)
+    {
+        header_includes.insert(other.header_includes.begin(), other.header_includes.end());
+        source_includes.insert(other.source_includes.begin(), other.source_includes.end());
+        perfect_hash_helpers = perfect_hash_helpers || other.perfect_hash_helpers;
+    }
+
+    void write_header(OutputFile* file) const
+    {
+        for(const auto& include: header_includes)
+        {
+            file->write("#include <" + include + ">\n");
+        }
+        if(perfect_hash_helpers)
+        {
+            file->write(PERFECT_HASH_HELPERS);
+        }
+        if(header_includes.empty() == false || perfect_hash_helpers)
+        {
+            file->write("\n");
+        }
+    }
+
+    void write_source(OutputFile* file) const
+    {
+        for(const auto& include: source_includes)
+        {
+            file->write("#include <" + include + ">\n");
+        }
+        if(source_includes.empty() == false)
+        {
+            file->write("\n");
+        }
+    }
+};
+
+struct Binding
+{
+    const Table* table;
+    std::size_t index; // in the binding stack
+};
+
+// lexical state while compiling, each xml element that changes it gets a copy
+struct Scope
+{
+    Target target = Target::header;
+    std::string between;
+    std::map<std::string, Binding> variables; // expanded variable -> binding
+    std::size_t depth = 0; // number of enclosing expansions
+};
+
+// a column written by <expand_columns>
+struct Field
+{
+    std::size_t column;
+    std::string type;
+    std::string name;
+    Transform transform;
+};
+
+// the attributes of an element that generates code from a column of a table
+struct TableColumn
+{
+    const char* name;
+    const Table* table;
+    std::size_t column; // 0 when the element doesn't take a col
+};
+
+struct Compiler
+{
+    std::string filename;
+    const AllTables& tables;
+    std::ostream& err;
+    Program program;
+    Prelude prelude;
+
+    // the target that is current after executing everything in the program so far
+    Target current_target = Target::header;
+    // texts are never merged across the start or end of a loop body
+    std::size_t merge_start = 0;
+
+    Compiler(const std::string& f, const AllTables& t, std::ostream& e)
+        : filename(f)
+        , tables(t)
+        , err(e)
+    {
+    }
+
+    void set_target(Target target)
+    {
+        if(current_target == target)
+        {
+            return;
+        }
+        Instruction inst{OpCode::switch_target};
+        inst.target = target;
+        program.push_back(inst);
+        current_target = target;
+    }
+
+    void emit_text(const Scope& scope, const std::string& text)
+    {
+        if(text.empty())
+        {
+            return;
+        }
+        set_target(scope.target);
+        if(program.size() > merge_start && program.back().op == OpCode::emit_text)
+        {
+            program.back().text += text;
+            return;
+        }
+        Instruction inst{OpCode::emit_text};
+        inst.text = text;
+        program.push_back(inst);
+    }
+
+    bool compile_loop(const Scope& scope, const Table& table, const std::string& var_name, XMLElement* elem)
+    {
+        set_target(scope.target);
+        const auto loop_index = program.size();
+        Instruction loop{OpCode::loop_table};
+        loop.text = scope.between;
+        loop.table = &table;
+        loop.binding = scope.depth;
+        program.push_back(loop);
+        merge_start = program.size();
+
+        Scope body = scope;
+        body.variables[var_name] = Binding{&table, scope.depth};
+        body.depth += 1;
+        const bool status = compile(elem, body);
+
+        // each row starts with the same target as the first
+        set_target(scope.target);
+        merge_start = program.size();
+        program[loop_index].body_size = program.size() - (loop_index + 1);
+        return status;
+    }
+
+    // a constexpr function from the key column to the value the body gives for the row, see build_perfect_hash
+    bool compile_perfect_hash(const Scope& scope, XMLElement* elem, const std::string& name, const std::string& type, const Table& table, std::size_t key_column, const std::string& var_name)
+    {
+        const auto row_count = table.row_count;
+        std::vector<std::uint64_t> hashes;
+        std::map<std::uint64_t, std::size_t> rows_by_hash;
+        for(std::size_t row = 0; row < row_count; row += 1)
+        {
+            const auto& key = table.cell(row, key_column);
+            const auto hash = key_hash(key);
+            const auto [found, inserted] = rows_by_hash.emplace(hash, row);
+            if(inserted == false)
             {
-                const char* table = elem->Attribute("name");
-                if(table == nullptr)
-                {
-                    ERR(elem, "Missing name property in var");
-                }
+                const auto& other = table.cell(found->second, key_column);
+                err << file_to_error(filename, elem) << "error: " << (other == key ? "duplicate key " : "hash collision for key ") << key << " in " << name << "\n";
+                return false;
+            }
+            hashes.push_back(hash);
+        }
 
-                const auto found_row = o.variables.find(table);
-                if(found_row == o.variables.end())
+        Scope h = scope;
+        h.target = Target::header;
+        prelude.header_includes.insert({"cstddef", "cstdint", "optional", "string_view"});
+        prelude.perfect_hash_helpers = true;
+
+        if(row_count == 0)
+        {
+            emit_text(h, "constexpr std::optional<" + type + "> " + name + "(std::string_view)\n{\n    return std::nullopt;\n}\n");
+            // nothing is written for no rows, but the body is still checked
+            return compile_loop(h, table, var_name, elem);
+        }
+
+        const auto hash = build_perfect_hash(hashes);
+        if(hash.has_value() == false)
+        {
+            err << file_to_error(filename, elem) << "error: Failed to build perfect hash for " << name << "\n";
+            return false;
+        }
+
+        const auto slot_count = std::to_string(row_count);
+        const auto bucket_count = std::to_string(hash->seeds.size());
+        std::ostringstream ss;
+        ss << "inline constexpr " << smallest_unsigned_type(*std::max_element(hash->seeds.begin(), hash->seeds.end())) << ' ' << name << "_seeds[" << bucket_count << "] = {";
+        for(std::size_t bucket = 0; bucket < hash->seeds.size(); bucket += 1)
+        {
+            ss << (bucket == 0 ? "" : ", ") << hash->seeds[bucket];
+        }
+        ss << "};\n";
+        // the length is given so the compiler doesn't have to evaluate strlen for every key
+        ss << "inline constexpr std::string_view " << name << "_keys[" << slot_count << "] = {";
+        for(std::size_t slot = 0; slot < row_count; slot += 1)
+        {
+            const auto& key = table.cell(hash->rows[slot], key_column);
+            ss << (slot == 0 ? "{" : ", {") << transform_string(Transform::string, key) << ", " << key.size() << '}';
+        }
+        ss << "};\n";
+        ss << "inline constexpr " << smallest_unsigned_type(row_count - 1) << ' ' << name << "_rows[" << slot_count << "] = {";
+        for(std::size_t slot = 0; slot < row_count; slot += 1)
+        {
+            ss << (slot == 0 ? "" : ", ") << hash->rows[slot];
+        }
+        ss << "};\n";
+        ss << "inline constexpr " << type << ' ' << name << "_values[" << slot_count << "] = {";
+        emit_text(h, ss.str());
+
+        Scope values = h;
+        values.between = ", ";
+        const bool status = compile_loop(values, table, var_name, elem);
+
+        emit_text(h, "};\n"
+            "constexpr std::optional<" + type + "> " + name + "(std::string_view key)\n"
+            "{\n"
+            "    const auto hash = smide_perfect_hash::hash(key);\n"
+            "    const auto slot = smide_perfect_hash::slot(hash, " + name + "_seeds[smide_perfect_hash::bucket(hash, " + bucket_count + ")], " + slot_count + ");\n"
+            "    // the hash only picks the slot, any string not in the table lands in one too\n"
+            "    if (" + name + "_keys[slot] != key)\n"
+            "    {\n"
+            "        return std::nullopt;\n"
+            "    }\n"
+            "    return " + name + "_values[" + name + "_rows[slot]];\n"
+            "}\n");
+        return status;
+    }
+
+    // a loop writing the fields of every row of table, each row between row_begin and row_end
+    void emit_rows(const Scope& scope, const Table& table, const std::vector<Field>& fields, const std::string& row_begin, const std::string& row_end, const std::string& between)
+    {
+        set_target(scope.target);
+        const auto loop_index = program.size();
+        Instruction loop{OpCode::loop_table};
+        loop.text = between;
+        loop.table = &table;
+        loop.binding = scope.depth;
+        program.push_back(loop);
+        merge_start = program.size();
+
+        Scope body = scope;
+        body.depth += 1;
+        emit_text(body, row_begin);
+        for(std::size_t index = 0; index < fields.size(); index += 1)
+        {
+            if(index != 0)
+            {
+                emit_text(body, ", ");
+            }
+            Instruction inst{OpCode::emit_column};
+            inst.table = &table;
+            inst.binding = scope.depth;
+            inst.column = fields[index].column;
+            inst.transform = fields[index].transform;
+            program.push_back(inst);
+        }
+        emit_text(body, row_end);
+
+        set_target(scope.target);
+        merge_start = program.size();
+        program[loop_index].body_size = program.size() - (loop_index + 1);
+    }
+
+    // reads name, table and col (when needs_column) of an element, the error is printed when one is missing or wrong
+    std::optional<TableColumn> find_table_column(XMLElement* elem, const std::string& element_name, bool needs_column)
+    {
+        const char* name = elem->Attribute("name");
+        if (name == nullptr)
+        {
+            err << file_to_error(filename, elem) << "error: Missing name property in " << element_name << "\n";
+            return std::nullopt;
+        }
+        const char* table = elem->Attribute("table");
+        if (table == nullptr)
+        {
+            err << file_to_error(filename, elem) << "error: Failed to find table prop\n";
+            return std::nullopt;
+        }
+        const auto& found = tables.find(table);
+        if (found == tables.end())
+        {
+            err << file_to_error(filename, elem) << "error: Failed to find table " << table << "\n";
+            return std::nullopt;
+        }
+        if (needs_column == false)
+        {
+            return TableColumn{name, &found->second, 0};
+        }
+        const char* col = elem->Attribute("col");
+        if (col == nullptr)
+        {
+            err << file_to_error(filename, elem) << "error: Missing col property in " << element_name << "\n";
+            return std::nullopt;
+        }
+        const auto column = found->second.column_index(col);
+        if (column.has_value() == false)
+        {
+            err << file_to_error(filename, elem) << "error: " << col << " is not a column in " << table << "\n";
+            return std::nullopt;
+        }
+        return TableColumn{name, &found->second, *column};
+    }
+
+    // the selected columns of a table as one array per column or as one array of structs
+    bool compile_columns(const Scope& scope, XMLElement* elem, const std::string& name, const Table& table)
+    {
+        std::vector<Field> fields;
+        for(auto* field_elem = elem->FirstChildElement(); field_elem; field_elem = field_elem->NextSiblingElement())
+        {
+            if(std::string{field_elem->Name()} != "field")
+            {
+                err << file_to_error(filename, field_elem) << "error: Invalid element " << field_elem->Name() << " in expand_columns\n";
+                return false;
+            }
+            const char* col = field_elem->Attribute("col");
+            const char* type = field_elem->Attribute("type");
+            if(col == nullptr || type == nullptr)
+            {
+                err << file_to_error(filename, field_elem) << "error: Missing " << (col == nullptr ? "col" : "type") << " property in field\n";
+                return false;
+            }
+            const auto column = table.column_index(col);
+            if(column.has_value() == false)
+            {
+                err << file_to_error(filename, field_elem) << "error: " << col << " is not a column in " << elem->Attribute("table") << "\n";
+                return false;
+            }
+            const char* field_name = field_elem->Attribute("name");
+            const char* transform = field_elem->Attribute("transform");
+            fields.push_back(Field{*column, type, field_name ? field_name : col, transform ? transform_from_name(transform, err) : Transform::none});
+        }
+        if(fields.empty())
+        {
+            err << file_to_error(filename, elem) << "error: No fields in " << name << "\n";
+            return false;
+        }
+
+        const char* layout_attribute = elem->Attribute("layout");
+        const std::string layout = layout_attribute ? layout_attribute : "soa";
+        if(layout != "soa" && layout != "aos")
+        {
+            err << file_to_error(filename, elem) << "error: Unknown layout " << layout << ", expected soa or aos\n";
+            return false;
+        }
+
+        Scope h = scope;
+        h.target = Target::header;
+        Scope s = scope;
+        s.target = Target::source;
+        const auto entries = "[" + std::to_string(table.row_count) + "]";
+        prelude.header_includes.insert("cstddef");
+        emit_text(h, "constexpr std::size_t " + name + "_count = " + std::to_string(table.row_count) + ";\n");
+
+        // zero sized arrays aren't C++, without rows the names are null pointers so code that loops to the count still compiles
+        const bool empty = table.row_count == 0;
+
+        if(layout == "soa")
+        {
+            // one array per column so a loop over one column only reads that column
+            for(const auto& field: fields)
+            {
+                if(empty)
                 {
-                    ERR(elem, table << " is not a expanded table");
+                    emit_text(h, "inline constexpr " + field.type + " const* " + name + "_" + field.name + " = nullptr;\n");
+                    continue;
                 }
-                const auto& row = found_row->second;
+                const auto declaration = "extern " + field.type + " const " + name + "_" + field.name + entries;
+                emit_text(h, declaration + ";\n");
+                emit_text(s, declaration + " = {");
+                emit_rows(s, table, {field}, "", "", ", ");
+                emit_text(s, "};\n");
+            }
+            return true;
+        }
+
+        // the source doesn't include the header so the struct is defined in both, the definitions are the same
+        // and guarded like the perfect hash helpers so a source that includes the header still compiles
+        // the guard is named after the element and not only the struct, the same struct in another namespace is another
+        // element and still gets defined there
+        const char* struct_attribute = elem->Attribute("struct");
+        const std::string struct_name = struct_attribute ? struct_attribute : name + "_row";
+        std::string guard = "SMIDE_STRUCT_" + std::filesystem::path{filename}.stem().string() + "_" + std::to_string(elem->GetLineNum()) + "_" + struct_name;
+        for(auto& c: guard)
+        {
+            if(std::isalnum(static_cast<unsigned char>(c)) == false)
+            {
+                c = '_';
+            }
+        }
+        std::string definition = "#ifndef " + guard + "\n#define " + guard + "\nstruct " + struct_name + "\n{\n";
+        for(const auto& field: fields)
+        {
+            definition += "    " + field.type + " " + field.name + ";\n";
+        }
+        definition += "};\n#endif\n";
+        if(empty)
+        {
+            emit_text(h, definition + "inline constexpr const " + struct_name + "* " + name + " = nullptr;\n");
+            return true;
+        }
+        const auto declaration = "extern const " + struct_name + " " + name + entries;
+        emit_text(h, definition + declaration + ";\n");
+        emit_text(s, definition + declaration + " = {\n");
+        emit_rows(s, table, fields, "    {", "}", ",\n");
+        emit_text(s, "\n};\n");
+        return true;
+    }
 
-                const char* col = elem->Attribute("col");
-                if(col == nullptr)
+    // the strings in a column as one blob with an offset and size for each row
+    bool compile_string_pool(const Scope& scope, const std::string& name, const Table& table, std::size_t column)
+    {
+        std::vector<const std::string*> strings;
+        std::size_t max_size = 0;
+        for(std::size_t row = 0; row < table.row_count; row += 1)
+        {
+            strings.push_back(&table.cell(row, column));
+            max_size = std::max(max_size, table.cell(row, column).size());
+        }
+        Scope h = scope;
+        h.target = Target::header;
+        prelude.header_includes.insert({"cstddef", "string_view"});
+        if(table.row_count == 0)
+        {
+            // zero sized offsets and sizes aren't C++, there is nothing to read anyway
+            emit_text(h, "constexpr std::size_t " + name + "_count = 0;\n"
+                "inline std::string_view " + name + "(std::size_t)\n"
+                "{\n"
+                "    return {};\n"
+                "}\n");
+            return true;
+        }
+
+        const auto pool = build_string_pool(strings);
+        const auto entries = "[" + std::to_string(table.row_count) + "]";
+        const auto offset_type = smallest_unsigned_type(pool.blob.size());
+        const auto size_type = smallest_unsigned_type(max_size);
+
+        prelude.header_includes.insert("cstdint");
+        prelude.source_includes.insert("cstdint");
+        emit_text(h, "constexpr std::size_t " + name + "_count = " + std::to_string(table.row_count) + ";\n"
+            "extern const char " + name + "_blob[" + std::to_string(pool.blob.size() + 1) + "];\n"
+            "extern const " + offset_type + " " + name + "_offsets" + entries + ";\n"
+            "extern const " + size_type + " " + name + "_sizes" + entries + ";\n"
+            "inline std::string_view " + name + "(std::size_t index)\n"
+            "{\n"
+            "    return std::string_view{" + name + "_blob + " + name + "_offsets[index], " + name + "_sizes[index]};\n"
+            "}\n");
+
+        // split over several literals, the sizes are stored so the strings don't need a 0 between them
+        constexpr std::size_t BYTES_PER_LINE = 100;
+        std::ostringstream ss;
+        ss << "extern const char " << name << "_blob[" << pool.blob.size() + 1 << "] =";
+        for(std::size_t index = 0; index < pool.blob.size() || index == 0; index += BYTES_PER_LINE)
+        {
+            ss << "\n    " << transform_string(Transform::string, pool.blob.substr(index, BYTES_PER_LINE));
+        }
+        ss << ";\nextern const " << offset_type << ' ' << name << "_offsets" << entries << " = {";
+        for(std::size_t row = 0; row < table.row_count; row += 1)
+        {
+            ss << (row == 0 ? "" : ", ") << pool.offsets[row];
+        }
+        ss << "};\nextern const " << size_type << ' ' << name << "_sizes" << entries << " = {";
+        for(std::size_t row = 0; row < table.row_count; row += 1)
+        {
+            ss << (row == 0 ? "" : ", ") << strings[row]->size();
+        }
+        ss << "};\n";
+
+        Scope s = scope;
+        s.target = Target::source;
+        emit_text(s, ss.str());
+        return true;
+    }
+
+    // the rows of a table sorted by a column with a binary search over it, string columns are sorted as std::string_view
+    // compares them and other columns as numbers
+    bool compile_sorted_index(const Scope& scope, XMLElement* elem, const std::string& name, const std::string& type, const Table& table, std::size_t column)
+    {
+        const auto row_count = table.row_count;
+        const bool string_keys = type == "std::string_view";
+        std::vector<std::size_t> rows(row_count);
+        for(std::size_t row = 0; row < row_count; row += 1)
+        {
+            rows[row] = row;
+        }
+
+        // integers are compared as integers so large ones don't lose precision, as unsigned when one is above LLONG_MAX
+        std::vector<long long> integers;
+        std::vector<unsigned long long> unsigned_integers;
+        std::vector<long double> numbers;
+        bool all_integers = true;
+        bool any_above_long_long = false;
+        bool any_negative = false;
+        if(string_keys)
+        {
+            std::stable_sort(rows.begin(), rows.end(), [&table, column](std::size_t lhs, std::size_t rhs) { return table.cell(lhs, column) < table.cell(rhs, column); });
+        }
+        else
+        {
+            integers.resize(row_count);
+            unsigned_integers.resize(row_count);
+            numbers.resize(row_count);
+            for(std::size_t row = 0; row < row_count; row += 1)
+            {
+                const auto& cell = table.cell(row, column);
+                const auto number = parse_number_cell(cell);
+                if(number.has_value() == false)
                 {
-                    ERR(elem, "Missing col property in var");
+                    err << file_to_error(filename, elem) << "error: " << cell << " in row " << row << " is not a finite number or a 64 bit integer, use type=\"std::string_view\" for strings\n";
+                    return false;
                 }
-                const auto found_var = row.find(col);
-                if(found_var == row.end())
+                integers[row] = number->integer_value;
+                unsigned_integers[row] = number->unsigned_value;
+                numbers[row] = number->value;
+                all_integers = all_integers && number->integer;
+                any_above_long_long = any_above_long_long || number->above_long_long;
+                any_negative = any_negative || (number->integer && number->integer_value < 0);
+            }
+            if(all_integers && any_above_long_long)
+            {
+                if(any_negative)
                 {
-                    // todo(Gustav): add a name to the table and not just the variable
-                    ERR(elem, col << " is not a column in " << table);
+                    err << file_to_error(filename, elem) << "error: " << name << " has negative keys and keys above " << LLONG_MAX << ", no integer type holds both\n";
+                    return false;
                 }
+                std::stable_sort(rows.begin(), rows.end(), [&unsigned_integers](std::size_t lhs, std::size_t rhs) { return unsigned_integers[lhs] < unsigned_integers[rhs]; });
+            }
+            else if(all_integers)
+            {
+                std::stable_sort(rows.begin(), rows.end(), [&integers](std::size_t lhs, std::size_t rhs) { return integers[lhs] < integers[rhs]; });
+            }
+            else
+            {
+                std::stable_sort(rows.begin(), rows.end(), [&numbers](std::size_t lhs, std::size_t rhs) { return numbers[lhs] < numbers[rhs]; });
+            }
+        }
+
+        const auto count = std::to_string(row_count);
+        const auto key_type = string_keys ? std::string{"std::string_view"} : type;
+        prelude.header_includes.insert({"cstddef", "cstdint", "optional", "string_view"});
+        std::ostringstream ss;
+        ss << "constexpr std::size_t " << name << "_count = " << count << ";\n";
+        if(row_count == 0)
+        {
+            ss << "constexpr std::size_t " << name << "_lower_bound(" << key_type << ")\n{\n    return 0;\n}\n";
+            ss << "constexpr std::optional<std::size_t> " << name << "_find(" << key_type << ")\n{\n    return std::nullopt;\n}\n";
+            Scope h = scope;
+            h.target = Target::header;
+            emit_text(h, ss.str());
+            return true;
+        }
 
-                const char* transform = elem->Attribute("transform");
-                o.write_string(transform ? transform_string(transform, found_var->second) : found_var->second);
+        ss << "inline constexpr " << key_type << ' ' << name << "_keys[" << count << "] = {";
+        for(std::size_t index = 0; index < row_count; index += 1)
+        {
+            ss << (index == 0 ? "" : ", ");
+            if(string_keys)
+            {
+                const auto& key = table.cell(rows[index], column);
+                ss << '{' << transform_string(Transform::string, key) << ", " << key.size() << '}';
             }
-            else if(name == "enum")
+            else
             {
-                const char* name = elem->Attribute("name");
-                if(name == nullptr)
+                // the parsed value and not the cell, so the keys are what they were sorted by
+                if(all_integers && any_above_long_long)
+                {
+                    ss << unsigned_literal(unsigned_integers[rows[index]]);
+                }
+                else
                 {
-                    ERR(elem, "Missing name property in enum");
+                    ss << (all_integers ? integer_literal(integers[rows[index]]) : number_literal(numbers[rows[index]]));
                 }
-                const auto& h = o.only_header();
-                h.write_raw("enum class ");
-                h.write_raw(name);
-                h.write_raw("{");
-                status = generate_rows(filename, elem, h) && status;
-                h.write_raw("\n};\n");
+            }
+        }
+        ss << "};\n";
+        ss << "inline constexpr " << smallest_unsigned_type(row_count - 1) << ' ' << name << "_rows[" << count << "] = {";
+        for(std::size_t index = 0; index < row_count; index += 1)
+        {
+            ss << (index == 0 ? "" : ", ") << rows[index];
+        }
+        ss << "};\n";
+        // halving without a branch on the compare, the loop runs the same number of times for every key
+        ss << "constexpr std::size_t " << name << "_lower_bound(" << key_type << " key)\n"
+            "{\n"
+            "    std::size_t first = 0;\n"
+            "    std::size_t size = " << count << ";\n"
+            "    while (size > 1)\n"
+            "    {\n"
+            "        const std::size_t half = size / 2;\n"
+            "        first = " << name << "_keys[first + half] < key ? first + half : first;\n"
+            "        size -= half;\n"
+            "    }\n"
+            "    return first + (" << name << "_keys[first] < key ? 1 : 0);\n"
+            "}\n";
+        ss << "constexpr std::optional<std::size_t> " << name << "_find(" << key_type << " key)\n"
+            "{\n"
+            "    const auto index = " << name << "_lower_bound(key);\n"
+            "    if (index == " << count << " || !(" << name << "_keys[index] == key))\n"
+            "    {\n"
+            "        return std::nullopt;\n"
+            "    }\n"
+            "    return " << name << "_rows[index];\n"
+            "}\n";
 
+        Scope h = scope;
+        h.target = Target::header;
+        emit_text(h, ss.str());
+        return true;
+    }
+
+    bool compile(XMLElement* root, const Scope& scope)
+    {
+        bool status = true;
+        for(auto* child = root->FirstChild(); child; child = child->NextSibling())
+        {
+            auto* text = child->ToText();
+            if(text != nullptr)
+            {
+                emit_text(scope, text->Value());
+                continue;
             }
-            else if(name == "expand_data")
+
+            auto* elem = child->ToElement();
+            if(elem)
             {
-                const char* name = elem->Attribute("name");
-                if (name == nullptr)
+                const std::string name = elem->Name();
+                if(name == "source")
                 {
-                    ERR(elem, "Missing name property in data");
+                    Scope s = scope;
+                    s.target = Target::source;
+                    status = compile(elem, s) && status;
                 }
-                const char* table = elem->Attribute("table");
-                if (table == nullptr)
+                else if (name == "header")
                 {
-                    ERR(elem, "Failed to find table prop");
+                    Scope h = scope;
+                    h.target = Target::header;
+                    status = compile(elem, h) && status;
                 }
-                const auto& found = o.tables->find(table);
-                if (found == o.tables->end())
+                else if (name == "expand")
                 {
-                    ERR(elem, "Failed to find table " << table);
+                    const char* table = elem->Attribute("table");
+                    if(table == nullptr)
+                    {
+                        ERR(elem, "Failed to find table prop");
+                    }
+                    const auto& found = tables.find(table);
+                    if(found == tables.end())
+                    {
+                        ERR(elem, "Failed to find table " << table);
+                    }
+
+                    const char* var_name = elem->Attribute("var");
+                    if(var_name == nullptr)
+                    {
+                        ERR(elem, "Failed to find prop var");
+                    }
+
+                    status = compile_loop(scope, found->second, var_name, elem) && status;
                 }
+                else if(name == "var")
+                {
+                    const char* table = elem->Attribute("name");
+                    if(table == nullptr)
+                    {
+                        ERR(elem, "Missing name property in var");
+                    }
+
+                    const auto found_binding = scope.variables.find(table);
+                    if(found_binding == scope.variables.end())
+                    {
+                        ERR(elem, table << " is not a expanded table");
+                    }
 
-                const char* var_name = elem->Attribute("var");
-                if (var_name == nullptr)
+                    const char* col = elem->Attribute("col");
+                    if(col == nullptr)
+                    {
+                        ERR(elem, "Missing col property in var");
+                    }
+                    const auto& binding = found_binding->second;
+                    const auto column = binding.table->column_index(col);
+                    if(column.has_value() == false)
+                    {
+                        // todo(Gustav): add a name to the table and not just the variable
+                        ERR(elem, col << " is not a column in " << table);
+                    }
+
+                    const char* transform = elem->Attribute("transform");
+
+                    set_target(scope.target);
+                    Instruction inst{OpCode::emit_column};
+                    inst.table = binding.table;
+                    inst.binding = binding.index;
+                    inst.column = *column;
+                    inst.transform = transform ? transform_from_name(transform, err) : Transform::none;
+                    program.push_back(inst);
+                }
+                else if(name == "enum")
                 {
-                    ERR(elem, "Failed to find prop var");
+                    const char* name = elem->Attribute("name");
+                    if(name == nullptr)
+                    {
+                        ERR(elem, "Missing name property in enum");
+                    }
+                    Scope h = scope;
+                    h.target = Target::header;
+                    emit_text(h, "enum class ");
+                    emit_text(h, name);
+                    emit_text(h, "{");
+                    status = compile(elem, h) && status;
+                    emit_text(h, "\n};\n");
                 }
+                else if(name == "expand_data")
+                {
+                    const char* name = elem->Attribute("name");
+                    if (name == nullptr)
+                    {
+                        ERR(elem, "Missing name property in data");
+                    }
+                    const char* table = elem->Attribute("table");
+                    if (table == nullptr)
+                    {
+                        ERR(elem, "Failed to find table prop");
+                    }
+                    const auto& found = tables.find(table);
+                    if (found == tables.end())
+                    {
+                        ERR(elem, "Failed to find table " << table);
+                    }
 
-                const auto num_entries = found->second.size();
-                std::ostringstream out_entries;
-                out_entries << '[' << num_entries << ']';
+                    const char* var_name = elem->Attribute("var");
+                    if (var_name == nullptr)
+                    {
+                        ERR(elem, "Failed to find prop var");
+                    }
 
-                const auto& h = o.only_header();
-                h.write_raw("extern ");
-                h.write_raw(name);
-                h.write_string(out_entries.str());
+                    const auto num_entries = found->second.row_count;
+                    std::ostringstream out_entries;
+                    out_entries << '[' << num_entries << ']';
 
-                h.write_raw(";\n");
+                    Scope h = scope;
+                    h.target = Target::header;
+                    emit_text(h, "extern ");
+                    emit_text(h, name);
+                    emit_text(h, out_entries.str());
+                    emit_text(h, ";\n");
 
-                const auto& s = o.only_source();
-                s.write_raw(name);
-                s.write_string(out_entries.str());
-                s.write_raw(" = {\n");
+                    Scope s = scope;
+                    s.target = Target::source;
+                    emit_text(s, name);
+                    emit_text(s, out_entries.str());
+                    emit_text(s, " = {\n");
 
-                status = expand(s.with_between(", "), found->second, var_name, elem) && status;
+                    s.between = ", ";
+                    status = compile_loop(s, found->second, var_name, elem) && status;
 
-                s.write_raw("\n};\n");
-            }
-            else
-            {
-                ERR(elem, "Invalid element " << name);
+                    emit_text(s, "\n};\n");
+                }
+                else if(name == "expand_columns")
+                {
+                    const auto found = find_table_column(elem, name, false);
+                    if (found.has_value() == false)
+                    {
+                        status = false;
+                        continue;
+                    }
+
+                    status = compile_columns(scope, elem, found->name, *found->table) && status;
+                }
+                else if(name == "string_pool")
+                {
+                    const auto found = find_table_column(elem, name, true);
+                    if (found.has_value() == false)
+                    {
+                        status = false;
+                        continue;
+                    }
+
+                    status = compile_string_pool(scope, found->name, *found->table, found->column) && status;
+                }
+                else if(name == "sorted_index")
+                {
+                    const auto found = find_table_column(elem, name, true);
+                    if (found.has_value() == false)
+                    {
+                        status = false;
+                        continue;
+                    }
+                    const char* type = elem->Attribute("type");
+                    if (type == nullptr)
+                    {
+                        ERR(elem, "Missing type property in sorted_index");
+                    }
+
+                    status = compile_sorted_index(scope, elem, found->name, type, *found->table, found->column) && status;
+                }
+                else if(name == "perfect_hash")
+                {
+                    const auto found = find_table_column(elem, name, true);
+                    if (found.has_value() == false)
+                    {
+                        status = false;
+                        continue;
+                    }
+                    const char* type = elem->Attribute("type");
+                    if (type == nullptr)
+                    {
+                        ERR(elem, "Missing type property in perfect_hash");
+                    }
+                    const char* var_name = elem->Attribute("var");
+                    if (var_name == nullptr)
+                    {
+                        ERR(elem, "Failed to find prop var");
+                    }
+
+                    status = compile_perfect_hash(scope, elem, found->name, type, *found->table, found->column, var_name) && status;
+                }
+                else
+                {
+                    ERR(elem, "Invalid element " << name);
+                }
             }
         }
-    }
 
-    return status;
-}
+        return status;
+    }
+};
 
-int main(int argc, char** argv)
+void execute(const Program& program, std::size_t first, std::size_t last, Output& o)
 {
-    if(argc < ARG_COUNT)
+    for(std::size_t index = first; index < last; index += 1)
     {
-        std::cerr << "Invalid number of arguments\n";
-        return -1;
-    }
+        const auto& inst = program[index];
+        switch(inst.op)
+        {
+        case OpCode::emit_text:
+            o.write_string(inst.text);
+            break;
+        case OpCode::switch_target:
+            o.target = inst.target;
+            break;
+        case OpCode::loop_table:
+            {
+                const auto body_first = index + 1;
+                const auto body_last = body_first + inst.body_size;
+                const auto row_count = inst.table->row_count;
+                o.bindings.push_back(0);
+                for (std::size_t row = 0; row < row_count; row += 1)
+                {
+                    if (row != 0) o.write_string(inst.text);
 
-    const char* const source_name = argv[SOURCE_ARG];
-    const char* const header_name = argv[HEADER_ARG];
+                    o.bindings.back() = row;
+                    execute(program, body_first, body_last, o);
+                }
+                o.bindings.pop_back();
+                index = body_last - 1;
+            }
+            break;
+        case OpCode::emit_column:
+            {
+                const auto& value = inst.table->cell(o.bindings[inst.binding], inst.column);
+                if(inst.transform == Transform::none)
+                {
+                    o.write_string(value);
+                }
+                else
+                {
+                    o.write_string(transform_string(inst.transform, value));
+                }
+            }
+            break;
+        }
+    }
+}
 
-    std::ofstream source_file{source_name};
-    // todo(Gustav): generate include directive
+// a xml file with its tables loaded and its gen block compiled, shared by all jobs that use it
+// the tables and the program keep their own copies of the strings so the document is thrown away after loading
+struct LoadedFile
+{
+    bool loaded = false;
+    AllTables tables;
+    Program program;
+    Prelude prelude;
 
-    std::ofstream header_file{header_name};
-    header_file << "#pragma once\n\n";
+    bool status = true;
+    std::string diagnostics;
+};
 
+std::unique_ptr<LoadedFile> load_file(const std::string& filename)
+{
+    auto file = std::make_unique<LoadedFile>();
+    MappedFile source; // the document points into it
+    XMLDocument doc;
+    std::ostringstream err;
     bool status = true;
 
-    for(int arg_index = ARG_COUNT; arg_index < argc; arg_index += 1)
+    // single pass loop so ERR can continue out of it
+    do
     {
-        XMLDocument doc;
-        const char* const filename = argv[arg_index];
-
-        if(doc.LoadFile(filename) != XML_SUCCESS)
+        if(source.open(filename) == false || doc.ParseInPlace(source.data(), source.size()) != XML_SUCCESS)
         {
             ERR(nullptr, "Failed to load file `" << filename << "`");
         }
+        file->loaded = true;
 
         auto* root = doc.RootElement();
         if(root == nullptr)
@@ -355,10 +1446,11 @@ int main(int argc, char** argv)
         }
 
         // load tables
-        AllTables all_tables;
+        AllTables& all_tables = file->tables;
         for(auto* table_elem = tables_list_elem->FirstChildElement(); table_elem; table_elem = table_elem->NextSiblingElement())
         {
-            Row default_values;
+            Table tab;
+            std::vector<std::string> default_values;
             constexpr const char* COL_NAME = "col";
             for (auto* col_elem = table_elem->FirstChildElement(COL_NAME); col_elem; col_elem = col_elem->NextSiblingElement(COL_NAME))
             {
@@ -368,25 +1460,116 @@ int main(int argc, char** argv)
                 {
                     ERR(col_elem, "Missing name");
                 }
-                default_values.insert(Row::value_type(col_name, col_def ? col_def : ""));
+                if(tab.column_index(col_name).has_value())
+                {
+                    continue;
+                }
+                tab.columns.emplace_back(col_name);
+                default_values.emplace_back(col_def ? col_def : "");
             }
-            Table tab;
             constexpr const char* ROW_NAME = "row";
             for (auto* row_elem = table_elem->FirstChildElement(ROW_NAME); row_elem; row_elem = row_elem->NextSiblingElement(ROW_NAME))
             {
-                Row row;
-                for(const auto& [arg_name, default_val] : default_values)
+                for(std::size_t column = 0; column < tab.columns.size(); column += 1)
                 {
-                    const char* const value = row_elem->Attribute(arg_name.c_str());
-                    row.insert(Row::value_type(arg_name, value ? value : default_val));
+                    const char* const value = row_elem->Attribute(tab.columns[column].c_str());
+                    tab.cells.emplace_back(value ? value : default_values[column]);
                 }
-                tab.push_back(row);
+                tab.row_count += 1;
             }
-            all_tables.insert(AllTables::value_type(table_elem->Name(), tab));
+            all_tables.insert(AllTables::value_type(table_elem->Name(), std::move(tab)));
+        }
+
+        Compiler compiler{filename, all_tables, err};
+        status = compiler.compile(gen, Scope{}) && status;
+        file->program = std::move(compiler.program);
+        file->prelude = std::move(compiler.prelude);
+    } while(false);
+
+    file->status = status;
+    file->diagnostics = err.str();
+    return file;
+}
+
+int run(int argc, char** argv, std::ostream& err, SharedInputs<LoadedFile>* inputs)
+{
+    const bool print_stats = take_flag(&argc, argv, "--stats");
+    const auto depfile_path = take_option(&argc, argv, "--depfile");
+    if(argc < ARG_COUNT)
+    {
+        err << "Invalid number of arguments\n";
+        return -1;
+    }
+    if(depfile_path && depfile_path->empty())
+    {
+        err << "Missing path for --depfile\n";
+        return -1;
+    }
+
+    const char* const source_name = argv[SOURCE_ARG];
+    const char* const header_name = argv[HEADER_ARG];
+
+    OutputFile source_file{source_name};
+    // todo(Gustav): generate include directive
+
+    OutputFile header_file{header_name};
+    header_file.write("#pragma once\n\n");
+
+    bool status = true;
+    Depfile depfile;
+    depfile.add_output(source_name);
+    depfile.add_output(header_name);
+
+    // every input is loaded before anything is written, the prelude of all of them goes first
+    std::vector<const LoadedFile*> files;
+    Prelude prelude;
+    for(int arg_index = ARG_COUNT; arg_index < argc; arg_index += 1)
+    {
+        const char* const filename = argv[arg_index];
+        const auto& file = inputs->get(filename, [filename]() { return load_file(filename); });
+        err << file.diagnostics;
+        status = file.status && status;
+        if(file.loaded)
+        {
+            depfile.add_input(filename);
         }
+        prelude.add(file.prelude);
+        files.push_back(&file);
+    }
+    prelude.write_header(&header_file);
+    prelude.write_source(&source_file);
 
-        status = generate_rows(filename, gen, Output{ &all_tables, &source_file, &header_file }) && status;
+    for(const auto* file: files)
+    {
+        Output output{ &source_file, &header_file };
+        execute(file->program, 0, file->program.size(), output);
+    }
+
+    for(auto* file : {&source_file, &header_file})
+    {
+        if(file->commit(err) == false)
+        {
+            status = false;
+        }
+        else if(print_stats)
+        {
+            file->print_stats(err);
+        }
+    }
+
+    if(depfile_path && depfile.write(*depfile_path, err) == false)
+    {
+        status = false;
     }
 
     return status ? 0 : -2;
 }
+
+int main(int argc, char** argv)
+{
+    SharedInputs<LoadedFile> inputs;
+    return run_jobs(argc, argv, [&inputs](int argc, char** argv, std::ostream& err, bool)
+    {
+        return run(argc, argv, err, &inputs);
+    });
+}
@@ -1,11 +1,31 @@
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <map>
-#include <fstream>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <sstream>
+#include <vector>
 
 #include "smide/rapidjson/document.h"
+#include "smide/rapidjson/error/en.h"
 #include "smide/mustache.hpp"
+#include "smide/args.h"
+#include "smide/depfile.h"
+#include "smide/mapped_file.h"
+#include "smide/manifest.h"
+#include "smide/output.h"
+#include "smide/template_cache.h"
+#include "smide/thread_pool.h"
 
 using namespace rapidjson;
 
@@ -18,129 +38,965 @@ enum
     ARG_COUNT
 };
 
-#define ERR(mess) std::cerr << "error: " << mess << "\n"; status = false; continue
+// with --render the patterns and outputs are given as options, the input is the only argument
+enum
+{
+    RENDER_APP_NAME_ARG,
+    RENDER_INPUT_FILE,
+    RENDER_ARG_COUNT
+};
 
+// records read before rendering a batch of a --lines input, for each thread
+constexpr std::size_t RECORDS_PER_THREAD = 64;
 
-kainjow::mustache::data json_to_data(const rapidjson::Value& doc)
-{
-    kainjow::mustache::data ret;
+// --lines runs at most this many threads per hardware thread, more only costs memory for the records
+constexpr std::size_t LINE_THREADS_PER_CORE = 4;
 
+#define ERR(mess) err << "error: " << mess << "\n"; status = false; continue
+
+
+// reports the json values that can't be used in a template, they are skipped when rendering
+void report_unsupported_values(const rapidjson::Value& doc, std::ostream& err)
+{
     if (!doc.IsObject())
     {
-        std::cerr << "JSON document is not an object\n";
-        return ret;
+        err << "JSON document is not an object\n";
+        return;
     }
 
     for (auto it = doc.MemberBegin(); it != doc.MemberEnd(); ++it)
     {
-        const std::string key = it->name.GetString();
-
         if (it->value.IsObject())
         {
-            ret[key] = json_to_data(it->value.GetObject());
+            report_unsupported_values(it->value, err);
         }
         else if (it->value.IsArray())
         {
-            kainjow::mustache::list list_data;
             for (auto& array_elem : it->value.GetArray())
             {
                 if (array_elem.IsObject())
                 {
-                    list_data.push_back(json_to_data(array_elem.GetObject()));
+                    report_unsupported_values(array_elem, err);
                 }
-                else if (array_elem.IsString())
+                else if (array_elem.IsString() == false)
+                {
+                    err << "Unsupported array element type for key: " << it->name.GetString() << "\n";
+                }
+            }
+        }
+        else if (it->value.IsString() == false && it->value.IsBool() == false && it->value.IsNumber() == false)
+        {
+            err << "Unsupported JSON value type for key: " << it->name.GetString() << "\n";
+        }
+    }
+}
+
+// a partial read from the --partials directory, shared by all jobs that use it
+struct LoadedPartial
+{
+    bool loaded = false;
+    kainjow::mustache::data text{kainjow::mustache::data::type::invalid};
+};
+
+// Partials that aren't in the json are looked up as files in a directory, named like the partial
+class PartialFiles
+{
+public:
+    PartialFiles(std::string directory, SharedInputs<LoadedPartial>* loaded)
+        : directory_(std::move(directory))
+        , loaded_(loaded)
+    {
+    }
+
+    const kainjow::mustache::data* get(const std::string& name)
+    {
+        const auto path = (std::filesystem::path{directory_} / name).string();
+        const auto& partial = loaded_->get(path, [&path]()
+        {
+            auto partial = std::make_unique<LoadedPartial>();
+            MappedFile file;
+            if (file.open(path))
+            {
+                partial->text = kainjow::mustache::data{std::string(file.data(), file.size())};
+                partial->loaded = true;
+            }
+            return partial;
+        });
+        if (partial.loaded == false)
+        {
+            return nullptr;
+        }
+        if (std::find(used_.begin(), used_.end(), path) == used_.end())
+        {
+            used_.push_back(path);
+        }
+        return &partial.text;
+    }
+
+    // the files that were read, for the depfile
+    const std::vector<std::string>& used() const
+    {
+        return used_;
+    }
+
+private:
+    std::string directory_;
+    SharedInputs<LoadedPartial>* loaded_;
+    std::vector<std::string> used_;
+};
+
+// Resolves names and sections directly against the json document.
+// Mustache data is only created for the values the template looks up and is released when the section that needed it ends.
+class JsonContext : public kainjow::mustache::basic_context<std::string>
+{
+public:
+    using data = kainjow::mustache::data;
+    using kainjow::mustache::basic_context<std::string>::get;
+
+    JsonContext(const rapidjson::Value& root, PartialFiles* partial_files)
+        : root_(data::type::object)
+        , partial_files_(partial_files)
+    {
+        items_.push_back(Item{&root_, &root});
+        marks_.push_back(0);
+    }
+
+    void push(const data* d) override
+    {
+        items_.push_back(Item{d, value_of(d)});
+        marks_.push_back(handles_.size());
+    }
+
+    void pop() override
+    {
+        items_.pop_back();
+        const auto mark = marks_.back();
+        marks_.pop_back();
+        while (handles_.size() > mark)
+        {
+            const auto& handle = handles_.back();
+            if (handle.shadowed == NO_HANDLE)
+            {
+                handle_by_value_.erase(handle.value);
+            }
+            else
+            {
+                handle_by_value_[handle.value] = handle.shadowed;
+            }
+            handles_.pop_back();
+        }
+    }
+
+    const data* get(const std::string& name) const override
+    {
+        // process {{.}} name
+        if (name.size() == 1 && name.at(0) == '.')
+        {
+            return items_.back().d;
+        }
+        if (name.find('.') == std::string::npos)
+        {
+            return find(name);
+        }
+        // process x.y-like name
+        return find_path(kainjow::mustache::split(name, '.'));
+    }
+
+    // names from the template, dotted ones are already split
+    const data* get(const kainjow::mustache::basic_key<std::string>& key, const kainjow::mustache::basic_path<std::string>& path) const override
+    {
+        if (path.empty())
+        {
+            return get(key.str());
+        }
+        return find_path(path);
+    }
+
+    const data* get_partial(const std::string& name) const override
+    {
+        if (const auto* found = find(name))
+        {
+            return found;
+        }
+        return partial_files_ ? partial_files_->get(name) : nullptr;
+    }
+
+private:
+    struct Item
+    {
+        const data* d;
+        const rapidjson::Value* value;
+    };
+
+    // mustache data for a json value, list items are in the same order as items
+    struct Handle
+    {
+        data d{data::type::invalid}; // set right after, don't allocate an object for nothing
+        const rapidjson::Value* value;
+        std::vector<const rapidjson::Value*> items;
+        std::size_t shadowed; // the handle of the same value in an outer section, restored when this one is popped
+    };
+
+    static constexpr std::size_t NO_HANDLE = static_cast<std::size_t>(-1);
+
+    static bool is_supported(const rapidjson::Value& value)
+    {
+        return value.IsObject() || value.IsArray() || value.IsString() || value.IsBool() || value.IsNumber();
+    }
+
+    // the last member with a usable value wins, like the object that was built before
+    const rapidjson::Value* find_member(const rapidjson::Value* object, const std::string& name) const
+    {
+        if (object->IsObject() == false)
+        {
+            return nullptr;
+        }
+        if (object->MemberCount() > SMALL_OBJECT_SIZE)
+        {
+            const auto& index = member_index(object);
+            const auto found = index.find(name);
+            return found != index.end() ? found->second : nullptr;
+        }
+        for (auto it = object->MemberEnd(); it != object->MemberBegin();)
+        {
+            --it;
+            if (name == it->name.GetString() && is_supported(it->value))
+            {
+                return &it->value;
+            }
+        }
+        return nullptr;
+    }
+
+    // the usable members of a wide object by name, built the first time a name is looked up in it
+    const std::unordered_map<std::string_view, const rapidjson::Value*>& member_index(const rapidjson::Value* object) const
+    {
+        auto [found, inserted] = member_indices_.try_emplace(object);
+        auto& index = found->second;
+        if (inserted)
+        {
+            index.reserve(object->MemberCount());
+            for (auto it = object->MemberBegin(); it != object->MemberEnd(); ++it)
+            {
+                if (is_supported(it->value))
                 {
-                    list_data.push_back(array_elem.GetString());
+                    // later members replace earlier ones with the same name
+                    index[it->name.GetString()] = &it->value;
                 }
-                else
+            }
+        }
+        return index;
+    }
+
+    // process normal name, searching from the innermost section and out
+    const data* find(const std::string& name) const
+    {
+        for (auto item = items_.rbegin(); item != items_.rend(); ++item)
+        {
+            if (const auto* value = find_member(item->value, name))
+            {
+                return make_handle(*value);
+            }
+        }
+        return nullptr;
+    }
+
+    template<typename Names>
+    const data* find_path(const Names& names) const
+    {
+        for (auto item = items_.rbegin(); item != items_.rend(); ++item)
+        {
+            const rapidjson::Value* value = item->value;
+            for (const auto& n : names)
+            {
+                value = find_member(value, n);
+                if (!value)
                 {
-                    std::cerr << "Unsupported array element type for key: " << key << "\n";
+                    break;
                 }
             }
-            ret[key] = list_data;
+            if (value)
+            {
+                return make_handle(*value);
+            }
+        }
+        return nullptr;
+    }
+
+    const data* make_handle(const rapidjson::Value& value) const
+    {
+        // a value looked up again in the same section, like a name used on every line, reuses the handle instead of growing the list
+        const auto found = handle_by_value_.find(&value);
+        if (found != handle_by_value_.end() && found->second >= marks_.back())
+        {
+            return &handles_[found->second].d;
         }
-        else if (it->value.IsString())
+        const auto shadowed = found != handle_by_value_.end() ? found->second : NO_HANDLE;
+        handle_by_value_[&value] = handles_.size();
+        auto& handle = handles_.emplace_back();
+        handle.value = &value;
+        handle.shadowed = shadowed;
+        if (value.IsObject())
         {
-            ret[key] = it->value.GetString();
+            // the members are looked up in the json when the object is pushed so no need to copy them
+            handle.d = data{data::type::object};
         }
-        else if (it->value.IsBool())
+        else if (value.IsArray())
         {
-            ret[key] = it->value.GetBool() ? "true" : "false";
+            handle.d = data{data::type::list};
+            for (auto& array_elem : value.GetArray())
+            {
+                if (array_elem.IsObject())
+                {
+                    handle.d.push_back(data{data::type::object});
+                    handle.items.push_back(&array_elem);
+                }
+                else if (array_elem.IsString())
+                {
+                    handle.d.push_back(array_elem.GetString());
+                    handle.items.push_back(&array_elem);
+                }
+            }
         }
-        else if (it->value.IsNumber())
+        else if (value.IsString())
         {
-            ret[key] = std::to_string(it->value.GetDouble());
+            handle.d = data{value.GetString()};
+        }
+        else if (value.IsBool())
+        {
+            handle.d = data{value.GetBool() ? "true" : "false"};
         }
         else
         {
-            std::cerr << "Unsupported JSON value type for key: " << key << "\n";
+            handle.d = data{std::to_string(value.GetDouble())};
+        }
+        return &handle.d;
+    }
+
+    // the renderer only pushes data we returned or items in a list we returned, most likely the latest
+    const rapidjson::Value* value_of(const data* d) const
+    {
+        for (auto handle = handles_.rbegin(); handle != handles_.rend(); ++handle)
+        {
+            if (&handle->d == d)
+            {
+                return handle->value;
+            }
+            if (handle->d.is_non_empty_list())
+            {
+                const auto& list = handle->d.list_value();
+                if (d >= list.data() && d < list.data() + list.size())
+                {
+                    return handle->items[static_cast<std::size_t>(d - list.data())];
+                }
+            }
         }
+        return items_.front().value;
     }
 
-    return ret;
+    // objects with more members than this get an index instead of being searched
+    static constexpr rapidjson::SizeType SMALL_OBJECT_SIZE = 8;
+
+    data root_;
+    PartialFiles* partial_files_;
+    std::vector<Item> items_; // innermost last
+    std::vector<std::size_t> marks_; // number of handles when each item was pushed
+    mutable std::deque<Handle> handles_;
+    mutable std::unordered_map<const rapidjson::Value*, std::size_t> handle_by_value_; // the innermost handle of each value
+    mutable std::unordered_map<const rapidjson::Value*, std::unordered_map<std::string_view, const rapidjson::Value*>> member_indices_;
+};
+
+// a parsed json input, shared by all jobs that use it
+struct LoadedInput
+{
+    bool loaded = false;
+    MappedFile source; // strings in the document point into it
+    rapidjson::Document json;
+    std::string diagnostics;
+};
+
+// a parsed mustache pattern, shared by all jobs that use it
+struct LoadedPattern
+{
+    bool loaded = false;
+    bool from_cache = false;
+    kainjow::mustache::mustache pattern;
+};
+
+struct SharedFiles
+{
+    SharedInputs<LoadedInput> inputs;
+    SharedInputs<LoadedPattern> patterns;
+    SharedInputs<LoadedPartial> partials;
+};
+
+std::unique_ptr<LoadedInput> load_input(const char* input_path)
+{
+    auto input = std::make_unique<LoadedInput>();
+    if(input->source.open(input_path) == false)
+    {
+        return input;
+    }
+    input->loaded = true;
+    // parsed in place, strings are terminated inside the mapped file instead of being copied
+    input->json.ParseInsitu<kParseCommentsFlag | kParseTrailingCommasFlag | kParseNanAndInfFlag>(input->source.data());
+    std::ostringstream err;
+    report_unsupported_values(input->json, err);
+    input->diagnostics = err.str();
+    return input;
 }
 
+std::unique_ptr<LoadedPattern> load_pattern(const char* pattern_path, const std::optional<TemplateCache>& cache)
+{
+    auto pattern = std::make_unique<LoadedPattern>();
+    std::string pattern_src;
+    {
+        MappedFile file;
+        if (file.open(pattern_path) == false)
+        {
+            return pattern;
+        }
+        pattern_src.assign(file.data(), file.size());
+        pattern->loaded = true;
+    }
+    auto cached = cache ? cache->load(pattern_src) : std::nullopt;
+    if (cached)
+    {
+        pattern->pattern = std::move(*cached);
+        pattern->from_cache = true;
+    }
+    else
+    {
+        pattern->pattern = kainjow::mustache::mustache{ pattern_src };
+        // invalid patterns are parsed again so the error is reported every time
+        if (cache && pattern->pattern.is_valid())
+        {
+            cache->store(pattern_src, pattern->pattern);
+        }
+    }
+    pattern->pattern.set_custom_escape([](const std::string& s) { return s; });
+    return pattern;
+}
 
-int main(int argc, char** argv)
+// the parsed pattern shared by the jobs, nullptr if it couldn't be used
+const LoadedPattern* get_pattern(const char* pattern_path, const std::optional<std::string>& cache_dir, SharedFiles* shared, std::ostream& err)
 {
-    if(argc != ARG_COUNT)
+    const auto& pattern = shared->patterns.get(pattern_path, [pattern_path, &cache_dir]()
     {
-        std::cerr << "Invalid number of arguments\n";
-        return -1;
+        const auto cache = cache_dir ? std::make_optional<TemplateCache>(*cache_dir) : std::nullopt;
+        return load_pattern(pattern_path, cache);
+    });
+    if (pattern.loaded == false)
+    {
+        err << "Failed to open " << pattern_path << "\n";
+        return nullptr;
     }
+    if (pattern.pattern.is_valid() == false)
+    {
+        const auto& error = pattern.pattern.error_message();
+        err << "Failed to parse mustache: " << error << "\n";
+        return nullptr;
+    }
+    return &pattern;
+}
 
-    const char* const pattern_path = argv[MODE_ARG];
-    const char* const input_path = argv[INPUT_FILE];
-    const char* const output_path = argv[OUTPUT_FILE];
+// a record of a --lines input and what is needed to render it, reused for the records of every batch
+// the parsed patterns a --lines record is rendered with, rendering isn't const so each thread gets its own copy
+struct LineRenderer
+{
+    kainjow::mustache::mustache pattern;
+    kainjow::mustache::mustache output_pattern;
+    std::optional<PartialFiles> partial_files;
+};
 
-    // ================================================================
-    // load json input
-    std::string json_src;
+// Renderers for the threads, a task takes one that no other task is using and gives it back when done.
+// Patterns can be big so they are copied once per thread that renders and not per record, a renderer is only made when
+// all are in use so there are never more than threads and few records only need a few.
+class LineRenderers
+{
+public:
+    LineRenderers(const kainjow::mustache::mustache& pattern, const kainjow::mustache::mustache& output_pattern,
+        const std::optional<std::string>& partials_dir, SharedFiles* shared)
+        : pattern_(pattern)
+        , output_pattern_(output_pattern)
+        , partials_dir_(partials_dir)
+        , shared_(shared)
+    {
+    }
+
+    LineRenderer* take()
     {
-        std::ifstream f(input_path);
-        if(f.good() == false)
         {
-            std::cerr << "Failed to open " << input_path << "\n";
-            return -1;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_.empty() == false)
+            {
+                auto* renderer = free_.back();
+                free_.pop_back();
+                return renderer;
+            }
+        }
+
+        // copied outside the lock so other threads can take and give back while this one copies
+        auto renderer = std::make_unique<LineRenderer>();
+        renderer->pattern = pattern_;
+        renderer->output_pattern = output_pattern_;
+        if (partials_dir_)
+        {
+            renderer->partial_files.emplace(*partials_dir_, &shared_->partials);
         }
-        json_src.assign((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        std::lock_guard<std::mutex> lock(mutex_);
+        all_.emplace_back(std::move(renderer));
+        return all_.back().get();
+    }
+
+    void give_back(LineRenderer* renderer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(renderer);
+    }
+
+    // only when no thread is rendering
+    const std::vector<std::unique_ptr<LineRenderer>>& all() const
+    {
+        return all_;
     }
+
+private:
+    const kainjow::mustache::mustache& pattern_;
+    const kainjow::mustache::mustache& output_pattern_;
+    const std::optional<std::string>& partials_dir_;
+    SharedFiles* shared_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<LineRenderer>> all_;
+    std::vector<LineRenderer*> free_;
+};
+
+struct LineRecord
+{
+    int line = 0;
+    std::string text; // the json is parsed in place
     rapidjson::Document json;
-    json.Parse<kParseCommentsFlag | kParseTrailingCommasFlag | kParseNanAndInfFlag>(json_src.c_str());
-    const auto data = json_to_data(json);
+    std::string output_path;
+    bool ok = true;
+    bool replaced = false; // a later record in the batch writes the same file
+    std::ostringstream err;
+};
+
+// runs the step for the records, on the pool if there is one
+void for_each_record(ThreadPool* pool, const std::vector<std::unique_ptr<LineRecord>>& records, std::size_t count, const std::function<void(LineRecord&)>& step)
+{
+    for (std::size_t index = 0; index < count; index += 1)
+    {
+        if (pool)
+        {
+            pool->add([&step, record = records[index].get()]() { step(*record); });
+        }
+        else
+        {
+            step(*records[index]);
+        }
+    }
+    if (pool)
+    {
+        pool->wait();
+    }
+}
+
+// Every line of the input is a json record that is rendered to its own file, the output path is a pattern rendered with
+// the same record. Records are read, rendered and released a batch at a time so memory doesn't grow with the input,
+// the output paths are only kept when there is a depfile to list them in.
+int run_lines(const LoadedPattern& pattern, const char* input_path, const char* output_pattern_src, std::size_t thread_count,
+    const std::optional<std::string>& partials_dir, bool print_stats, SharedFiles* shared, Depfile* depfile, std::ostream& err)
+{
+    kainjow::mustache::mustache output_pattern{std::string{output_pattern_src}};
+    if (output_pattern.is_valid() == false)
+    {
+        err << "Failed to parse output path mustache: " << output_pattern.error_message() << "\n";
+        return -1;
+    }
+    output_pattern.set_custom_escape([](const std::string& s) { return s; });
+
+    std::ifstream file(input_path);
+    if (file.good() == false)
+    {
+        err << "Failed to open " << input_path << "\n";
+        return -1;
+    }
+    if (depfile)
+    {
+        depfile->add_input(input_path);
+    }
+
+    const std::size_t cores = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, cores * LINE_THREADS_PER_CORE);
+    if (thread_count > std::numeric_limits<std::size_t>::max() / RECORDS_PER_THREAD)
+    {
+        err << "Too many threads " << thread_count << "\n";
+        return -1;
+    }
+    const std::size_t record_count = thread_count * RECORDS_PER_THREAD;
+
+    LineRenderers renderers{pattern.pattern, output_pattern, partials_dir, shared};
+    std::vector<std::unique_ptr<LineRecord>> records;
+    for (std::size_t index = 0; index < record_count; index += 1)
+    {
+        records.emplace_back(std::make_unique<LineRecord>());
+    }
+    std::optional<ThreadPool> pool;
+    if (thread_count > 1)
+    {
+        pool.emplace(thread_count);
+    }
+
+    bool status = true;
+    int line_number = 0;
+    bool more = true;
+    while (more)
+    {
+        std::size_t count = 0;
+        while (count < records.size())
+        {
+            auto& record = *records[count];
+            if (!std::getline(file, record.text))
+            {
+                more = false;
+                break;
+            }
+            line_number += 1;
+            if (record.text.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            record.line = line_number;
+            count += 1;
+        }
+
+        for_each_record(pool ? &*pool : nullptr, records, count, [&renderers](LineRecord& record)
+        {
+            record.ok = true;
+            record.replaced = false;
+            record.err.str("");
+            record.json.ParseInsitu<kParseCommentsFlag | kParseTrailingCommasFlag | kParseNanAndInfFlag>(record.text.data());
+            if (record.json.HasParseError())
+            {
+                record.err << "error: invalid json, " << GetParseError_En(record.json.GetParseError()) << "\n";
+                record.ok = false;
+                return;
+            }
+            report_unsupported_values(record.json, record.err);
+            JsonContext context{record.json, nullptr};
+            record.output_path.clear();
+            auto* renderer = renderers.take();
+            renderer->output_pattern.render(context, [&record](const std::string& text) { record.output_path += text; });
+            renderers.give_back(renderer);
+            if (record.output_path.empty())
+            {
+                record.err << "error: the output path is empty\n";
+                record.ok = false;
+            }
+        });
+
+        // the records of a batch are rendered at the same time, when two of them write the same file only the last one
+        // does so the result is the same as rendering them one after the other
+        std::unordered_map<std::string_view, LineRecord*> writers;
+        for (std::size_t index = 0; index < count; index += 1)
+        {
+            auto& record = *records[index];
+            if (record.ok == false)
+            {
+                continue;
+            }
+            auto& writer = writers[record.output_path];
+            if (writer)
+            {
+                writer->replaced = true;
+            }
+            writer = &record;
+            if (depfile)
+            {
+                depfile->add_output(record.output_path);
+            }
+        }
+
+        for_each_record(pool ? &*pool : nullptr, records, count, [&renderers, print_stats](LineRecord& record)
+        {
+            if (record.ok && record.replaced == false)
+            {
+                OutputFile out{record.output_path};
+                auto* renderer = renderers.take();
+                JsonContext context{record.json, renderer->partial_files ? &*renderer->partial_files : nullptr};
+                const auto copies_before = kainjow::mustache::data::copy_count();
+                renderer->pattern.render(context, [&out](const std::string& text) { out.write(text); });
+                const auto data_copies = kainjow::mustache::data::copy_count() - copies_before;
+                renderers.give_back(renderer);
+                if (out.commit(record.err) == false)
+                {
+                    record.ok = false;
+                }
+                else if (print_stats)
+                {
+                    record.err << record.output_path << ": " << data_copies << " mustache data copies\n";
+                    out.print_stats(record.err);
+                }
+            }
+            record.json = rapidjson::Document{};
+        });
+
+        // printed in input order, every message is prefixed with the line of the record
+        for (std::size_t index = 0; index < count; index += 1)
+        {
+            auto& record = *records[index];
+            std::istringstream messages{record.err.str()};
+            std::string message;
+            while (std::getline(messages, message))
+            {
+                err << input_path << '(' << record.line << "): " << message << "\n";
+            }
+            if (record.ok == false)
+            {
+                status = false;
+            }
+        }
+    }
+
+    for (const auto& renderer: renderers.all())
+    {
+        if (depfile && renderer->partial_files)
+        {
+            for (const auto& path: renderer->partial_files->used())
+            {
+                depfile->add_input(path);
+            }
+        }
+    }
+    return status ? 0 : -1;
+}
+
+// a pattern rendered to an output file with the shared json input
+struct Render
+{
+    std::string pattern_path;
+    std::string output_path;
+
+    int result = 0;
+    std::ostringstream err;
+    std::vector<std::string> inputs; // read for this render, for the depfile
+};
 
+void render_pattern(Render* render, const LoadedInput& json, const std::optional<std::string>& cache_dir, const std::optional<std::string>& partials_dir, bool print_stats, SharedFiles* shared)
+{
+    auto& err = render->err;
 
     // ================================================================
     // load pattern
-    std::string pattern_src;
+    const auto* pattern = get_pattern(render->pattern_path.c_str(), cache_dir, shared, err);
+    if (pattern == nullptr)
+    {
+        render->result = -1;
+        return;
+    }
+    render->inputs.push_back(render->pattern_path);
+    // rendering isn't const so each render gets its own copy of the parsed pattern
+    auto input = pattern->pattern;
+
+
+    // ================================================================
+    // write output file
+    OutputFile out{render->output_path};
+    std::optional<PartialFiles> partial_files;
+    if (partials_dir)
+    {
+        partial_files.emplace(*partials_dir, &shared->partials);
+    }
+    JsonContext context{json.json, partial_files ? &*partial_files : nullptr};
+    const auto copies_before = kainjow::mustache::data::copy_count();
+    input.render(context, [&out](const std::string& text) { out.write(text); });
+    const auto data_copies = kainjow::mustache::data::copy_count() - copies_before;
+    if (partial_files)
+    {
+        render->inputs.insert(render->inputs.end(), partial_files->used().begin(), partial_files->used().end());
+    }
+    if (out.commit(err) == false)
+    {
+        render->result = -1;
+        return;
+    }
+    if (print_stats)
+    {
+        if (cache_dir)
+        {
+            err << render->pattern_path << ": parsed template cache " << (pattern->from_cache ? "hit" : "miss") << "\n";
+        }
+        err << render->output_path << ": " << data_copies << " mustache data copies\n";
+        out.print_stats(err);
+    }
+}
+
+int run(int argc, char** argv, std::ostream& err, SharedFiles* shared, bool manifest_job)
+{
+    const bool print_stats = take_flag(&argc, argv, "--stats");
+    const bool lines = take_flag(&argc, argv, "--lines");
+    const auto threads = take_option(&argc, argv, "--threads");
+    const auto depfile_path = take_option(&argc, argv, "--depfile");
+    const auto cache_dir = take_option(&argc, argv, "--cache-dir");
+    const auto partials_dir = take_option(&argc, argv, "--partials");
+    const auto render_options = take_options(&argc, argv, "--render");
+    if(render_options.empty() ? argc != ARG_COUNT : argc != RENDER_ARG_COUNT)
+    {
+        err << "Invalid number of arguments\n";
+        return -1;
+    }
+    if(depfile_path && depfile_path->empty())
+    {
+        err << "Missing path for --depfile\n";
+        return -1;
+    }
+    if(cache_dir && cache_dir->empty())
+    {
+        err << "Missing path for --cache-dir\n";
+        return -1;
+    }
+    if(partials_dir && partials_dir->empty())
+    {
+        err << "Missing path for --partials\n";
+        return -1;
+    }
+    if(lines && render_options.empty() == false)
+    {
+        err << "--render can't be used with --lines\n";
+        return -1;
+    }
+    // the jobs of a manifest already run on a thread pool of their own
+    std::size_t thread_count = manifest_job ? 1 : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    if(threads)
+    {
+        if(lines == false && render_options.empty())
+        {
+            err << "--threads requires --lines or --render\n";
+            return -1;
+        }
+        const auto count = parse_count(*threads);
+        if(count.has_value() == false)
+        {
+            err << "Invalid number of threads " << *threads << "\n";
+            return -1;
+        }
+        thread_count = *count;
+    }
+
+    std::vector<std::unique_ptr<Render>> renders;
+    for(const auto& option: render_options)
     {
-        std::ifstream f(pattern_path);
-        if (f.good() == false)
+        const auto parsed = parse_pattern_output(option);
+        if(parsed.has_value() == false)
         {
-            std::cerr << "Failed to open " << pattern_path << "\n";
+            err << "Invalid --render " << option << ", expected pattern=output\n";
             return -1;
         }
-        pattern_src.assign((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        auto render = std::make_unique<Render>();
+        render->pattern_path = parsed->pattern;
+        render->output_path = parsed->output;
+        renders.emplace_back(std::move(render));
     }
-    auto input = kainjow::mustache::mustache{ pattern_src };
-    if (input.is_valid() == false)
+    if(renders.empty())
     {
-        const auto& error = input.error_message();
-        std::cerr << "Failed to parse mustache: " << error << "\n";
-        return - 1;
+        auto render = std::make_unique<Render>();
+        render->pattern_path = argv[MODE_ARG];
+        render->output_path = argv[OUTPUT_FILE];
+        renders.emplace_back(std::move(render));
     }
-    input.set_custom_escape([](const std::string& s) { return s; });
+    const char* const input_path = render_options.empty() ? argv[INPUT_FILE] : argv[RENDER_INPUT_FILE];
 
+    Depfile depfile;
+
+    if (lines)
+    {
+        const auto& pattern_path = renders.front()->pattern_path;
+        const auto* pattern = get_pattern(pattern_path.c_str(), cache_dir, shared, err);
+        if (pattern == nullptr)
+        {
+            return -1;
+        }
+        depfile.add_input(pattern_path);
+        if (print_stats && cache_dir)
+        {
+            err << pattern_path << ": parsed template cache " << (pattern->from_cache ? "hit" : "miss") << "\n";
+        }
+        const int result = run_lines(*pattern, input_path, renders.front()->output_path.c_str(), thread_count, partials_dir, print_stats, shared, depfile_path ? &depfile : nullptr, err);
+        if (result != 0)
+        {
+            return result;
+        }
+        if (depfile_path && depfile.write(*depfile_path, err) == false)
+        {
+            return -1;
+        }
+        return 0;
+    }
 
     // ================================================================
-    // write output file
-    std::ofstream out(output_path);
-    if (out.good() == false)
+    // load json input, once for all the renders
+    const auto& json = shared->inputs.get(input_path, [input_path]() { return load_input(input_path); });
+    if(json.loaded == false)
+    {
+        err << "Failed to open " << input_path << "\n";
+        return -1;
+    }
+    depfile.add_input(input_path);
+    err << json.diagnostics;
+
+    // the renders only share read only data so they can run at the same time
+    const auto render = [&](Render* r) { render_pattern(r, json, cache_dir, partials_dir, print_stats, shared); };
+    if (renders.size() > 1 && thread_count > 1)
+    {
+        ThreadPool pool{std::min(thread_count, renders.size())};
+        for (auto& r: renders)
+        {
+            pool.add([&render, r = r.get()]() { render(r); });
+        }
+        pool.wait();
+    }
+    else
+    {
+        for (auto& r: renders)
+        {
+            render(r.get());
+        }
+    }
+
+    // printed in the order the renders were given
+    int result = 0;
+    for (const auto& r: renders)
+    {
+        err << r->err.str();
+        if (r->result != 0 && result == 0)
+        {
+            result = r->result;
+        }
+        depfile.add_output(r->output_path);
+        for (const auto& path: r->inputs)
+        {
+            depfile.add_input(path);
+        }
+    }
+    if (result != 0)
+    {
+        return result;
+    }
+    if (depfile_path && depfile.write(*depfile_path, err) == false)
     {
-        std::cerr << "Failed to open file for writing: " << output_path;
         return -1;
     }
-    out << input.render(data);
 
     return 0;
 }
+
+int main(int argc, char** argv)
+{
+    SharedFiles shared;
+    return run_jobs(argc, argv, [&shared](int argc, char** argv, std::ostream& err, bool manifest_job)
+    {
+        return run(argc, argv, err, &shared, manifest_job);
+    });
+}
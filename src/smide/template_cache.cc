@@ -0,0 +1,222 @@
+#include "smide/template_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+#include "smide/mapped_file.h"
+#include "smide/output.h"
+
+using component = kainjow::mustache::component<std::string>;
+
+namespace
+{
+    // bump when the layout changes
+    constexpr std::uint32_t FORMAT_VERSION = 1;
+    constexpr char MAGIC[8] = {'s', 'm', 'i', 'd', 'e', 'm', 't', 'c'};
+
+    std::uint64_t hash_source(const std::string& source)
+    {
+        // fnv-1a
+        std::uint64_t hash = 14695981039346656037ull;
+        for(const char c: source)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    struct Writer
+    {
+        std::string buffer;
+
+        void u8(std::uint8_t value)
+        {
+            buffer.push_back(static_cast<char>(value));
+        }
+
+        void u64(std::uint64_t value)
+        {
+            char bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            buffer.append(bytes, sizeof(value));
+        }
+
+        void string(const std::string& value)
+        {
+            u64(value.size());
+            buffer.append(value);
+        }
+
+        void comp(const component& c)
+        {
+            u8(static_cast<std::uint8_t>(c.tag.type));
+            string(c.text);
+            string(c.tag.name.str());
+            u64(c.position);
+
+            u8(c.tag.section_text ? 1 : 0);
+            if(c.tag.section_text)
+            {
+                string(*c.tag.section_text);
+            }
+
+            u8(c.tag.delim_set ? 1 : 0);
+            if(c.tag.delim_set)
+            {
+                string(c.tag.delim_set->begin);
+                string(c.tag.delim_set->end);
+            }
+
+            u64(c.children.size());
+            for(const auto& child: c.children)
+            {
+                comp(child);
+            }
+        }
+    };
+
+    // fails instead of reading past the end so a truncated or foreign file is just a cache miss
+    struct Reader
+    {
+        const char* data;
+        std::size_t size;
+        std::size_t offset = 0;
+
+        bool bytes(void* dest, std::size_t count)
+        {
+            if(size - offset < count)
+            {
+                return false;
+            }
+            std::memcpy(dest, data + offset, count);
+            offset += count;
+            return true;
+        }
+
+        bool u8(std::uint8_t* value)
+        {
+            return bytes(value, sizeof(*value));
+        }
+
+        bool u64(std::uint64_t* value)
+        {
+            return bytes(value, sizeof(*value));
+        }
+
+        bool string(std::string* value)
+        {
+            std::uint64_t length = 0;
+            if(u64(&length) == false || size - offset < length)
+            {
+                return false;
+            }
+            value->assign(data + offset, static_cast<std::size_t>(length));
+            offset += static_cast<std::size_t>(length);
+            return true;
+        }
+
+        bool comp(component* c)
+        {
+            std::uint8_t type = 0;
+            std::uint64_t position = 0;
+            if(u8(&type) == false || type > static_cast<std::uint8_t>(kainjow::mustache::tag_type::set_delimiter)) return false;
+            c->tag.type = static_cast<kainjow::mustache::tag_type>(type);
+            std::string name;
+            if(string(&c->text) == false || string(&name) == false || u64(&position) == false) return false;
+            c->tag.name = std::move(name);
+            c->position = static_cast<std::string::size_type>(position);
+            c->tag.prepare_lookup();
+
+            std::uint8_t has_section_text = 0;
+            if(u8(&has_section_text) == false) return false;
+            if(has_section_text)
+            {
+                c->tag.section_text = std::make_shared<std::string>();
+                if(string(c->tag.section_text.get()) == false) return false;
+            }
+
+            std::uint8_t has_delim_set = 0;
+            if(u8(&has_delim_set) == false) return false;
+            if(has_delim_set)
+            {
+                c->tag.delim_set = std::make_shared<kainjow::mustache::delimiter_set<std::string>>();
+                if(string(&c->tag.delim_set->begin) == false || string(&c->tag.delim_set->end) == false) return false;
+            }
+
+            std::uint64_t child_count = 0;
+            // each child needs more than one byte so this also protects against silly counts
+            if(u64(&child_count) == false || child_count > size - offset) return false;
+            c->children.resize(static_cast<std::size_t>(child_count));
+            for(auto& child: c->children)
+            {
+                if(comp(&child) == false) return false;
+            }
+            return true;
+        }
+    };
+
+    void write_header(Writer* writer, const std::string& source)
+    {
+        writer->buffer.append(MAGIC, sizeof(MAGIC));
+        writer->u64(FORMAT_VERSION);
+        writer->u64(KAINJOW_MUSTACHE_VERSION_MAJOR * 10000 + KAINJOW_MUSTACHE_VERSION_MINOR * 100 + KAINJOW_MUSTACHE_VERSION_PATCH);
+        writer->u64(1); // detects a cache written on a machine with another byte order
+        // the hash only picks the file, the source is stored to rule out collisions
+        writer->string(source);
+    }
+}
+
+TemplateCache::TemplateCache(std::string directory)
+    : directory_(std::move(directory))
+{
+}
+
+std::string TemplateCache::path_for(const std::string& source) const
+{
+    std::ostringstream ss;
+    ss << std::hex << hash_source(source) << '-' << source.size() << ".smide-template";
+    return (std::filesystem::path{directory_} / ss.str()).string();
+}
+
+std::optional<kainjow::mustache::mustache> TemplateCache::load(const std::string& source) const
+{
+    MappedFile stored;
+    if(stored.open(path_for(source)) == false)
+    {
+        return std::nullopt;
+    }
+
+    Writer expected_header;
+    write_header(&expected_header, source);
+    const auto header_size = expected_header.buffer.size();
+    if(stored.size() < header_size || std::memcmp(stored.data(), expected_header.buffer.data(), header_size) != 0)
+    {
+        return std::nullopt;
+    }
+
+    Reader reader{stored.data(), stored.size(), header_size};
+    component root;
+    if(reader.comp(&root) == false || reader.offset != stored.size())
+    {
+        return std::nullopt;
+    }
+    return kainjow::mustache::mustache{std::move(root)};
+}
+
+void TemplateCache::store(const std::string& source, const kainjow::mustache::mustache& pattern) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+
+    Writer writer;
+    write_header(&writer, source);
+    writer.comp(pattern.root_component());
+
+    OutputFile file{path_for(source)};
+    file.write(writer.buffer);
+    std::ostringstream ignored;
+    file.commit(ignored);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "smide/mustache.hpp"
+
+// Parsed mustache patterns stored in a directory, keyed by a hash of the pattern source, so later runs can skip parsing.
+// The stored form is a flat, position independent buffer so it can be read (or mapped) and turned into a pattern in one pass.
+class TemplateCache
+{
+public:
+    explicit TemplateCache(std::string directory);
+
+    // returns the parsed pattern if the cache has one for this source
+    std::optional<kainjow::mustache::mustache> load(const std::string& source) const;
+
+    // errors are ignored, a failed store only means the next run parses again
+    void store(const std::string& source, const kainjow::mustache::mustache& pattern) const;
+
+private:
+    std::string path_for(const std::string& source) const;
+
+    std::string directory_;
+};
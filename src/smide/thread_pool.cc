@@ -0,0 +1,119 @@
+#include "smide/thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+    if(thread_count == 0)
+    {
+        thread_count = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    for(std::size_t index = 0; index < thread_count; index += 1)
+    {
+        queues_.emplace_back(std::make_unique<Queue>());
+    }
+    for(std::size_t index = 0; index < thread_count; index += 1)
+    {
+        threads_.emplace_back([this, index]() { run_worker(index); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for(auto& thread: threads_)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::add(Task task)
+{
+    auto& queue = *queues_[next_queue_.fetch_add(1) % queues_.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_ += 1;
+        pending_ += 1;
+    }
+    work_available_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    all_done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+bool ThreadPool::pop_own(std::size_t worker, Task* task)
+{
+    auto& queue = *queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.tasks.empty())
+    {
+        return false;
+    }
+    *task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::steal(std::size_t worker, Task* task)
+{
+    for(std::size_t offset = 1; offset < queues_.size(); offset += 1)
+    {
+        auto& queue = *queues_[(worker + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty() == false)
+        {
+            *task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_worker(std::size_t worker)
+{
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_available_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+            if(queued_ == 0)
+            {
+                return;
+            }
+            // claim one task, it's either in our own queue or can be stolen from another
+            queued_ -= 1;
+        }
+
+        Task task;
+        while(pop_own(worker, &task) == false && steal(worker, &task) == false)
+        {
+            // a task we passed was taken by another worker, look again
+            std::this_thread::yield();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ -= 1;
+            if(pending_ != 0)
+            {
+                continue;
+            }
+        }
+        all_done_.notify_all();
+    }
+}
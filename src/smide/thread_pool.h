@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads. Every worker has its own queue and steals from the others when its queue is empty.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(std::size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void add(Task task);
+
+    // blocks until all added tasks have run
+    void wait();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop_own(std::size_t worker, Task* task);
+    bool steal(std::size_t worker, Task* task);
+    void run_worker(std::size_t worker);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> next_queue_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_done_;
+    std::size_t queued_ = 0;  // added but not yet picked up by a worker
+    std::size_t pending_ = 0; // added but not yet finished
+    bool stopping_ = false;
+};
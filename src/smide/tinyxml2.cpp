@@ -21,6 +21,13 @@ must not be misrepresented as being the original software.
 distribution.
 */
 
+/*
+Modified for smide: this is tinyxml2 11.0.0 with XMLDocument::ParseInPlace()
+added so a document can be parsed from a caller owned buffer (such as a mapped
+file) without copying it. XMLDocument::_ownsCharBuffer tracks whether Clear()
+should free the buffer.
+*/
+
 #include "tinyxml2.h"
 
 #include <new>		// yes, this one new style header, is in the Android SDK.
@@ -2189,6 +2196,7 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
     _errorStr(),
     _errorLineNum( 0 ),
     _charBuffer( 0 ),
+    _ownsCharBuffer( true ),
     _parseCurLineNum( 0 ),
 	_parsingDepth(0),
     _unlinked(),
@@ -2233,8 +2241,11 @@ void XMLDocument::Clear()
 #endif
     ClearError();
 
-    delete [] _charBuffer;
+    if ( _ownsCharBuffer ) {
+        delete [] _charBuffer;
+    }
     _charBuffer = 0;
+    _ownsCharBuffer = true;
 	_parsingDepth = 0;
 
 #if 0
@@ -2475,6 +2486,31 @@ XMLError XMLDocument::Parse( const char* xml, size_t nBytes )
 }
 
 
+XMLError XMLDocument::ParseInPlace( char* xml, size_t nBytes )
+{
+    Clear();
+
+    if ( nBytes == 0 || !xml || !*xml ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
+    }
+    TIXMLASSERT( xml[nBytes] == 0 );
+    _charBuffer = xml;
+    _ownsCharBuffer = false;
+
+    Parse();
+    if ( Error() ) {
+        // same cleanup as Parse( const char*, size_t )
+        DeleteChildren();
+        _elementPool.Clear();
+        _attributePool.Clear();
+        _textPool.Clear();
+        _commentPool.Clear();
+    }
+    return _errorID;
+}
+
+
 void XMLDocument::Print( XMLPrinter* streamer ) const
 {
     if ( streamer ) {
@@ -21,6 +21,13 @@ must not be misrepresented as being the original software.
 distribution.
 */
 
+/*
+Modified for smide: this is tinyxml2 11.0.0 with XMLDocument::ParseInPlace()
+added so a document can be parsed from a caller owned buffer (such as a mapped
+file) without copying it. XMLDocument::_ownsCharBuffer tracks whether Clear()
+should free the buffer.
+*/
+
 #ifndef TINYXML2_INCLUDED
 #define TINYXML2_INCLUDED
 
@@ -1752,6 +1759,17 @@ public:
     */
     XMLError Parse( const char* xml, size_t nBytes=static_cast<size_t>(-1) );
 
+    /**
+    	Parse an XML buffer without copying it. Parsing modifies
+    	the buffer and the document keeps pointing into it, so it
+    	must stay alive and writable until the document is cleared
+    	or destroyed. xml[nBytes] must be 0.
+    	Returns XML_SUCCESS (0) on success, or
+    	an errorID.
+    	Not in upstream tinyxml2, added for smide.
+    */
+    XMLError ParseInPlace( char* xml, size_t nBytes );
+
     /**
     	Load an XML file from disk.
     	Returns XML_SUCCESS (0) on success, or
@@ -1941,6 +1959,7 @@ private:
     mutable StrPair	_errorStr;
     int             _errorLineNum;
     char*			_charBuffer;
+    bool			_ownsCharBuffer;	// added for smide, false after ParseInPlace()
     int				_parseCurLineNum;
 	int				_parsingDepth;
 	// Memory tracking does add some overhead.
@@ -0,0 +1,54 @@
+# runs a smide tool and compares the files it writes with the expected files of a golden case
+# cmake -DCASE_DIR=<dir> -DOUTPUT_DIR=<dir> -P golden.cmake -- <tool> <args>...
+# the tool runs in CASE_DIR so paths written to the outputs are relative, every file in CASE_DIR/expected must be
+# written to OUTPUT_DIR with the same name and content
+
+set(command )
+set(in_command OFF)
+math(EXPR last_arg "${CMAKE_ARGC} - 1")
+foreach(index RANGE ${last_arg})
+    if(in_command)
+        list(APPEND command "${CMAKE_ARGV${index}}")
+    elseif(CMAKE_ARGV${index} STREQUAL "--")
+        set(in_command ON)
+    endif()
+endforeach()
+if(NOT command)
+    message(FATAL_ERROR "No command given after --")
+endif()
+
+file(REMOVE_RECURSE ${OUTPUT_DIR})
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+execute_process(
+    COMMAND ${command}
+    WORKING_DIRECTORY ${CASE_DIR}
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${command} failed with ${result}")
+endif()
+
+file(GLOB expected_files RELATIVE ${CASE_DIR}/expected ${CASE_DIR}/expected/*)
+if(NOT expected_files)
+    message(FATAL_ERROR "No expected files in ${CASE_DIR}/expected")
+endif()
+set(failed OFF)
+foreach(name ${expected_files})
+    if(NOT EXISTS ${OUTPUT_DIR}/${name})
+        message(SEND_ERROR "${name} wasn't written")
+        set(failed ON)
+        continue()
+    endif()
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${CASE_DIR}/expected/${name} ${OUTPUT_DIR}/${name}
+        RESULT_VARIABLE different
+    )
+    if(different)
+        file(READ ${OUTPUT_DIR}/${name} written)
+        message(SEND_ERROR "${name} differs from the expected file, it was:\n${written}")
+        set(failed ON)
+    endif()
+endforeach()
+if(failed)
+    message(FATAL_ERROR "${CASE_DIR} doesn't match the expected files")
+endif()
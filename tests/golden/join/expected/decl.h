@@ -0,0 +1,8 @@
+#line 2 "first.xml"
+int first();
+
+
+#line 2 "second.xml"
+int second();
+
+
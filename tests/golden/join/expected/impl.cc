@@ -0,0 +1,8 @@
+#line 4 "first.xml"
+int first() { return 1; }
+
+
+#line 4 "second.xml"
+int second() { return 2; }
+
+
@@ -0,0 +1,2 @@
+{{name}}: {{#tags}}{{.}} {{/tags}}{{^tags}}no tags{{/tags}}
+{{#info}}size {{info.size}}{{/info}}
@@ -0,0 +1,6 @@
+#pragma once
+namespace golden
+{
+    struct Point;
+    struct Empty;
+}
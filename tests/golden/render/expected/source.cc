@@ -0,0 +1,12 @@
+namespace golden
+{
+    struct Point
+    {
+        int x;
+        int y = 3;
+    };
+    struct Empty
+    {
+        
+    };
+}
@@ -0,0 +1,7 @@
+#pragma once
+namespace {{namespace}}
+{
+    {{#classes}}
+    struct {{name}};
+    {{/classes}}
+}
@@ -0,0 +1,11 @@
+namespace {{namespace}}
+{
+    {{#classes}}
+    struct {{name}}
+    {
+        {{#members}}
+        {{type}} {{name}}{{#default}} = {{.}}{{/default}};
+        {{/members}}
+    };
+    {{/classes}}
+}
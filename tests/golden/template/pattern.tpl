@@ -0,0 +1,44 @@
+// {{title}} by {{&author}}, escaped {{author}} and {{{author}}}
+{{! a standalone comment is removed with its line }}
+{{#enabled}}
+enabled is true
+{{/enabled}}
+{{^disabled}}
+disabled is false
+{{/disabled}}
+{{#missing}}
+never printed
+{{/missing}}
+{{^missing}}
+missing is inverted
+{{/missing}}
+{{^items}}
+never printed, items isn't empty
+{{/items}}
+{{#empty}}
+never printed, empty list
+{{/empty}}
+{{^empty}}
+empty list is inverted
+{{/empty}}
+{{#items}}
+item {{name}} = {{value}}{{#flags}} [{{.}}]{{/flags}} in {{title}}
+  {{#nested}}
+  nested {{inner.name}} of {{name}}
+  {{/nested}}
+{{/items}}
+dotted {{config.size.width}}x{{config.size.height}}, {{#config.size}}section {{width}}{{/config.size}}
+{{#config}}
+in config {{size.width}} and outer {{title}}
+{{/config}}
+number {{count}} and {{ratio}}, bool {{enabled}}
+  {{> header}}
+{{> footer}}
+{{=<% %>=}}
+changed <% title %> and {{title}}
+<%#items%>
+  <% name %>
+<%/items%>
+<%={{ }}=%>
+restored {{title}}
+inline {{#enabled}}yes{{/enabled}}{{^enabled}}no{{/enabled}} end
@@ -0,0 +1,136 @@
+// checks the lookups generated by smide_table from examples/table.enum.xml and tests/table.check.xml
+// the generator and the generated code hash keys with separate code, a key that misses its row means they disagree
+// the sorted indices must be sorted by the values the compiler reads, not by how the cells are written
+// string keys must keep their length and escapes, and a duplicated key must find its first row
+// the elements written inside a namespace must compile and work like the ones at global scope
+// the string pool must give back every string of its column while sharing the bytes of duplicates and suffixes
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "table.enum.h"
+#include "table.check.h"
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const std::string& message)
+    {
+        if(ok == false)
+        {
+            std::cerr << "error: " << message << "\n";
+            failures += 1;
+        }
+    }
+}
+
+static_assert(parse_my_enum("B") == MyEnum::MyEnum_B, "parse_my_enum must be usable at compile time");
+
+int main()
+{
+    for(std::size_t row = 0; row < myenum_count; row += 1)
+    {
+        const std::string key = myenum_strings[row];
+        check(parse_my_enum(key) == static_cast<MyEnum>(row), "parse_my_enum(" + key + ") didn't find its row");
+        check(parse_my_enum(key + "x").has_value() == false, "parse_my_enum(" + key + "x) found a row");
+    }
+    for(const auto* missing: {"", "a", "D", "AB", "MyEnum_A"})
+    {
+        check(parse_my_enum(missing).has_value() == false, std::string{"parse_my_enum("} + missing + ") found a row");
+    }
+
+    for(std::size_t row = 0; row < keys_count; row += 1)
+    {
+        const std::string key = keys_key[row];
+        check(find_key(key) == keys_index[row], "find_key(" + key + ") didn't find its row");
+        check(key_rows[row].index == keys_index[row] && key_rows[row].key == key, "key_rows and keys differ at " + key);
+        check(wrapped_a::key_rows[row].index == keys_index[row] && wrapped_b::key_rows[row].key == key,
+            "the wrapped key_rows differ at " + key);
+        check(wrapped_a::keys_index[row] == keys_index[row] && wrapped_b::keys_index[row] == keys_index[row],
+            "the wrapped keys_index differ at " + key);
+
+        // same length with a different last character, and one character longer
+        if(key.empty() == false)
+        {
+            std::string changed = key;
+            changed.back() = '#';
+            check(find_key(changed).has_value() == false, "find_key(" + changed + ") found a row");
+        }
+        check(find_key(key + "#").has_value() == false, "find_key(" + key + "#) found a row");
+        check(wrapped_a::find_key(key) == keys_index[row], "wrapped_a::find_key(" + key + ") didn't find its row");
+        check(wrapped_b::find_key(key) == keys_index[row], "wrapped_b::find_key(" + key + ") didn't find its row");
+    }
+
+    for(std::size_t row = 0; row < numbers_count; row += 1)
+    {
+        const auto value = std::to_string(numbers_value[row]);
+        const auto integer_value = std::to_string(numbers_integer_value[row]);
+        check(by_number_find(numbers_value[row]) == row, "by_number_find(" + value + ") didn't find its row");
+        check(by_integer_find(numbers_integer_value[row]) == row, "by_integer_find(" + integer_value + ") didn't find its row");
+        check(by_big_find(numbers_big[row]) == row, "by_big_find(" + std::to_string(numbers_big[row]) + ") didn't find its row");
+    }
+    for(std::size_t index = 1; index < numbers_count; index += 1)
+    {
+        check(by_number_keys[index - 1] < by_number_keys[index], "by_number_keys isn't sorted at " + std::to_string(index));
+        check(by_integer_keys[index - 1] < by_integer_keys[index], "by_integer_keys isn't sorted at " + std::to_string(index));
+        check(by_big_keys[index - 1] < by_big_keys[index], "by_big_keys isn't sorted at " + std::to_string(index));
+    }
+    check(by_number_find(3.5).has_value() == false, "by_number_find(3.5) found a row");
+    check(by_number_lower_bound(3.5) == 3, "by_number_lower_bound(3.5) isn't after -3, 1.5 and 2.25");
+    check(by_integer_find(10).has_value() == false, "by_integer_find(10) found a row");
+    check(by_big_find(0xfffffffffffffffeull).has_value() == false, "by_big_find(0xfffffffffffffffe) found a row");
+
+    for(std::size_t row = 0; row < names_count; row += 1)
+    {
+        const std::string_view name = names_name[row];
+        std::size_t first = 0;
+        while(names_name[first] != name)
+        {
+            first += 1;
+        }
+        check(by_name_find(name) == first, "by_name_find(" + std::string{name} + ") didn't find its first row");
+        check(wrapped_a::by_name_find(name) == first && wrapped_b::by_name_find(name) == first, "the wrapped by_name_find("
+            + std::string{name} + ") didn't find its first row");
+    }
+    for(std::size_t index = 0; index < by_name_count; index += 1)
+    {
+        check(by_name_keys[index] == names_name[by_name_rows[index]], "by_name_keys isn't the name of its row at " + std::to_string(index));
+        if(index > 0)
+        {
+            check(by_name_keys[index - 1] <= by_name_keys[index], "by_name_keys isn't sorted at " + std::to_string(index));
+        }
+    }
+    check(by_name_lower_bound("") == 0, "by_name_lower_bound(\"\") isn't the first key");
+    for(const auto* missing: {"ca", "cats", "tab", "zzz"})
+    {
+        check(by_name_find(missing).has_value() == false, std::string{"by_name_find("} + missing + ") found a row");
+    }
+
+    std::size_t pooled_size = 0;
+    for(std::size_t row = 0; row < names_count; row += 1)
+    {
+        const std::string name = names_name[row];
+        check(pooled_name(row) == name, "pooled_name(" + std::to_string(row) + ") isn't " + name);
+        check(wrapped_a::pooled_name(row) == name && wrapped_b::pooled_name(row) == name, "the wrapped pooled_name("
+            + std::to_string(row) + ") isn't " + name);
+        pooled_size += name.size();
+    }
+    // only concat, hotdog, x, the long string, quote"d, back\slash and the tab and newline need bytes of their own, the 0 is
+    // the terminator
+    const std::size_t blob_size = sizeof(pooled_name_blob) - 1;
+    check(blob_size == 6 + 6 + 1 + 147 + 7 + 10 + 12, "pooled_name_blob is " + std::to_string(blob_size) + " bytes, "
+        + std::to_string(pooled_size) + " without sharing");
+
+    check(empty_columns_count == 0 && empty_columns_name == nullptr, "empty_columns has rows");
+    check(empty_rows_count == 0 && empty_rows == nullptr, "empty_rows has rows");
+    check(empty_pool_count == 0 && empty_pool(0).empty(), "empty_pool has strings");
+
+    if(failures > 0)
+    {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}